@@ -1,6 +1,7 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <stdlib.h>
 
 #include "objectscript.h"
@@ -12,6 +13,7 @@
 #include "portability_fixes.hpp"
 #include "stlplus_version.hpp"
 #include "rlutil.h"
+#include "picosha2.h"
 #include "IceTeaPlugin.h"
 #include "InternalIceTeaPlugin.h"
 
@@ -54,23 +56,17 @@ void performIceTeaEvent(IceTea* it, const string& name, int expected=0) {
     it->callF(1,expected);
 }
 
-IceTea::IceTea() : OS() {
+IceTea::IceTea() : OS(), cli(NULL), fc(NULL) {
     // Fetch thread number beforehand!
     thrs_sst << thread::hardware_concurrency();
 
     // Tell Pluma about our provider.
     manager.acceptProviderType<IceTeaPluginProvider>();
 
-    // Attach the compiled-in modules...
-    IceTeaInternalPlugins* int_plugins = InternalPluginStore::getStore();
-    IceTeaInternalPlugins::iterator it;
-    for(it = int_plugins->begin(); it!=int_plugins->end(); ++it) {
-        manager.addProvider(*it);
-    }
-
     // Should we debug?
+    // The interpreter is not initialized yet; initSettings() picks this up.
     const char* envDebug = getenv("DEBUG");
-    this->setDebug(envDebug != NULL);
+    this->shouldDebug = envDebug != NULL;
 }
 
 IceTea* IceTea::create(OS::MemoryManager* manager) {
@@ -83,9 +79,14 @@ void IceTea::initSettings() {
     this->setSetting(OS_SETTING_CREATE_TEXT_EVAL_OPCODES, 0);
     this->setSetting(OS_SETTING_CREATE_COMPILED_FILE,     0);
     this->setSetting(OS_SETTING_SOURCECODE_MUST_EXIST,    1);
+    // debug "..." statements are only compiled in when debugging.
+    this->setSetting(OS_SETTING_COMPILE_DEBUG_CALLS,      this->shouldDebug);
 }
 
 IceTea::~IceTea() {
+    for(size_t i = 0; i < lazyModules.size(); i++) {
+        delete lazyModules[i];
+    }
     while(!plugins.empty()) {
         IceTeaPlugin* p = plugins.back();
         plugins.pop_back(); // Why is this not one single method?...
@@ -111,7 +112,10 @@ void IceTea::setupArguments() {
             "Amount of jobs to run at the same time. Default: "+thrs_sst.str(),
             true, thrs_sst.str()
         );
-        this->cli->insert("-p", "--purge", "", "Purge the cache file.");
+        this->cli->insert("-l", "--load-average", "<load>", "Don't start new jobs while the load average is above <load>.");
+        this->cli->insert("", "--max-mem", "<bytes>", "Don't start jobs whose estimated memory would exceed <bytes>. Accepts K, M and G suffixes.");
+        this->cli->insert("-k", "--keep-going", "[N]", "Keep building what does not depend on a failure. Stop after N failures; 0 or none means never.", true, "0");
+        this->cli->insert("-p", "--purge", "", "Purge the cache file and the compiled scripts.");
         this->cli->insert("-t", "--target", "<target>", "Build only the specified target.");
     }
 
@@ -119,6 +123,8 @@ void IceTea::setupArguments() {
     {
         this->cli->insert("", "--no-color", "", "Disable colors.");
         this->cli->insert("", "--detail-output", "", "Force detailed output.");
+        this->cli->insert("", "--log-format", "<format>", "Also write a machine-readable event stream. Supported: jsonl");
+        this->cli->insert("", "--log-file", "<file>", "Where to write the event stream to. Use fd:N for a file descriptor. Default: standard error output.");
     }
 
     this->cli->group("Developer options");
@@ -132,6 +138,8 @@ void IceTea::setupArguments() {
         this->cli->insert("-x", "--os", "<file>", "Run an ObjectScript file. Only it will be ran, other options are ignored.");
         this->cli->insert("-e", "--exec", "<str>", "Run ObjectScript code from string, or if - was given, then from standard input.");
         this->cli->insert("-W", "--warn", "", "Display warnings.");
+        this->cli->insert("", "--profile-script", "<file>", "Sample the build scripts. Collapsed stacks go to <file>, the busiest functions to standard error output.");
+        this->cli->insert("", "--vm-stats", "<file>", "Count executed opcodes, native function calls and their time, GC cycles and allocations per phase. Written to <file> as JSON on exit.");
     }
 
     this->cli->group("Build options");
@@ -159,6 +167,14 @@ void IceTea::setupArguments() {
 }
 
 bool IceTea::initializeModules() {
+    // Attach the compiled-in modules...
+    // The manager owns them from here on, so only one instance may do this.
+    IceTeaInternalPlugins* int_plugins = InternalPluginStore::getStore();
+    IceTeaInternalPlugins::iterator iit;
+    for(iit = int_plugins->begin(); iit!=int_plugins->end(); ++iit) {
+        manager.addProvider(*iit);
+    }
+
     vector<IceTeaPluginProvider*> providers;
     manager.getProviders(providers);
     vector<IceTeaPluginProvider*>::iterator it;
@@ -172,31 +188,46 @@ bool IceTea::initializeModules() {
 
     // Initialize the scripted modules
     // FIXME: Move into Modules.
-    struct ScriptMap_t {
-        const char*             name;
-        const unsigned char*    script;
-        int                     len;
-    };
     #define _s(file, symbol) {"(internal):" file, INCBIN_DATA(symbol), INCBIN_LEN(symbol)}
-    ScriptMap_t scripts[] = {
+    EmbeddedScript scripts[] = {
         _s("std.os", STD),
         _s("underscore.os", Underscore),
         _s("configurable.os", Configurable),
         _s("IceTea.os", libIceTea),
-        _s("detect.os", Detector),
-        _s("detect.utils.os", DetectorUtils),
-        _s("autoconf.os", Autoconf),
         {}
     };
-    ScriptMap_t* list = &scripts[0];
+    EmbeddedScript* list = &scripts[0];
 
+    double start = OS::getTimeSec();
     while(list->name && list->script) {
-        string script(reinterpret_cast<const char*>(list->script), list->len);
-        this->evalFakeFile(list->name, script.c_str());
+        this->evalFakeFile(list->name, list->script, list->len);
         if(this->hasEndedExecuting()) return false;
         list++;
     }
 
+    // The detector is only needed to configure. Scripts run with -x, the
+    // help and builds that are up to date never read it.
+    const char* detectGlobals[] = {"detect", "CompilerInfo", "LinkerInfo", "StaticLibraryInfo", NULL};
+    EmbeddedScript detectScripts[] = {
+        _s("detect.os", Detector),
+        _s("detect.utils.os", DetectorUtils),
+        {}
+    };
+    this->addLazyModule(detectGlobals, detectScripts);
+
+    const char* autoconfGlobals[] = {"autoconf", NULL};
+    EmbeddedScript autoconfScripts[] = {
+        _s("autoconf.os", Autoconf),
+        {}
+    };
+    this->addLazyModule(autoconfGlobals, autoconfScripts);
+    #undef _s
+
+    stringstream ss;
+    ss << "Evaluated the scripted modules in " << (int)((OS::getTimeSec() - start) * 1000) << " ms. "
+       << "detect.os, detect.utils.os and autoconf.os are evaluated on first use.";
+    this->printDebug(ss.str());
+
     if(this->shouldDebug) {
         this->eval("_G.DEBUG=true");
     } else {
@@ -224,8 +255,144 @@ bool IceTea::initializeModules() {
     return true;
 }
 
+void IceTea::addLazyModule(const char** globals, const EmbeddedScript* scripts) {
+    LazyModule* module = new LazyModule();
+    module->loaded = false;
+    for(; scripts->name; scripts++) {
+        module->scripts.push_back(*scripts);
+    }
+    for(; *globals; globals++) {
+        string name = *globals;
+        module->globals.push_back(name);
+
+        // A plugin may have started the module natively, like detect. Keep
+        // that object for the scripts to extend.
+        this->getGlobal(name.c_str(), false, false);
+        if(!this->isNull()) {
+            int id = this->getValueId();
+            this->retainValueById(id);
+            module->natives[name] = id;
+            this->pushGlobals();
+            this->deleteProperty(name.c_str(), false);
+        }
+        this->pop();
+    }
+    this->addLazyAccessors(module);
+    lazyModules.push_back(module);
+}
+
+void IceTea::addLazyAccessors(LazyModule* module) {
+    vector<string>::iterator it;
+    for(it = module->globals.begin(); it != module->globals.end(); ++it) {
+        this->pushGlobals();
+        this->pushString(it->c_str());
+        this->pushCFunction(lazyGlobal, 1, module);
+        this->setProperty(-2, ("__get@" + *it).c_str(), false);
+        this->pushString(it->c_str());
+        this->pushCFunction(lazySetGlobal, 1, module);
+        this->setProperty(-2, ("__set@" + *it).c_str(), false);
+        this->pop();
+    }
+}
+
+bool IceTea::loadLazyModule(LazyModule* module) {
+    if(module->loaded) return true;
+
+    // Drop the accessors and put the native objects back, so the scripts
+    // see the real globals.
+    vector<string>::iterator it;
+    for(it = module->globals.begin(); it != module->globals.end(); ++it) {
+        this->pushGlobals();
+        this->deleteProperty(("__get@" + *it).c_str(), false);
+        this->pushGlobals();
+        this->deleteProperty(("__set@" + *it).c_str(), false);
+        map<string, int>::iterator native = module->natives.find(*it);
+        if(native != module->natives.end()) {
+            this->pushValueById(native->second);
+            this->setGlobal(it->c_str(), false);
+        }
+    }
+
+    double start = OS::getTimeSec();
+    stringstream names;
+    for(size_t i = 0; i < module->scripts.size(); i++) {
+        const EmbeddedScript& script = module->scripts[i];
+        this->evalFakeFile(script.name, script.script, script.len);
+        if(this->isExceptionSet()) {
+            // Take back what the scripts made, the next use starts over.
+            for(it = module->globals.begin(); it != module->globals.end(); ++it) {
+                this->pushGlobals();
+                this->deleteProperty(it->c_str(), false);
+            }
+            this->addLazyAccessors(module);
+            return false;
+        }
+        names << (i ? ", " : "") << script.name;
+    }
+    module->loaded = true;
+    map<string, int>::iterator native;
+    for(native = module->natives.begin(); native != module->natives.end(); ++native) {
+        this->releaseValueById(native->second);
+    }
+    module->natives.clear();
+
+    stringstream ss;
+    ss << "Evaluated " << names.str() << " on first use in "
+       << (int)((OS::getTimeSec() - start) * 1000) << " ms.";
+    this->printDebug(ss.str());
+    return true;
+}
+
+int IceTea::lazyGlobal(OS* os, int params, int closure_values, int need_ret_values, void* user_param) {
+    // _G.__get@<name>, the name is the closure value.
+    string name = os->toString(-closure_values).toChar();
+    if(!((IceTea*)os)->loadLazyModule((LazyModule*)user_param)) {
+        return 0;
+    }
+    os->getGlobal(name.c_str(), false);
+    return 1;
+}
+
+int IceTea::lazySetGlobal(OS* os, int params, int closure_values, int need_ret_values, void* user_param) {
+    // _G.__set@<name>: a script may replace the global before it reads it.
+    string name = os->toString(-closure_values).toChar();
+    if(!((IceTea*)os)->loadLazyModule((LazyModule*)user_param)) {
+        return 0;
+    }
+    os->pushStackValue(-params-closure_values);
+    os->setGlobal(name.c_str(), false);
+    return 0;
+}
+
+bool IceTea::startupWorker(const vector<string>& names) {
+    // Only the named plugins, created straight from the store.
+    IceTeaInternalPlugins* int_plugins = InternalPluginStore::getStore();
+    IceTeaInternalPlugins::iterator it;
+    for(it = int_plugins->begin(); it!=int_plugins->end(); ++it) {
+        IceTeaPlugin* p = (*it)->create();
+        if(find(names.begin(), names.end(), p->getName()) == names.end()) {
+            delete p;
+            continue;
+        }
+        plugins.push_back(p);
+        if(! p->configure(this)) {
+            return false;
+        }
+    }
+
+    // std.os extends $, which the Generic plugin would create.
+    this->getModule("$");
+    this->pop();
+
+    this->evalFakeFile("(internal):std.os", INCBIN_DATA(STD), INCBIN_LEN(STD));
+    if(this->hasEndedExecuting()) return false;
+    this->eval("_G.DEBUG=false; _G.debug=function(){}");
+    return !this->hasEndedExecuting();
+}
+
 void IceTea::setDebug(bool debug) {
     this->shouldDebug = debug;
+    this->setSetting(OS_SETTING_COMPILE_DEBUG_CALLS, debug);
 }
 
 bool IceTea::getDebug() {
@@ -233,8 +400,8 @@ bool IceTea::getDebug() {
 }
 
 void IceTea::printDebug(string msg) {
-    if(this->shouldDebug || this->cli->check("--debug")) {
-        if(!cli->check("--no-color")) {
+    if(this->shouldDebug) {
+        if(cli == NULL || !cli->check("--no-color")) {
             rlutil::saveDefaultColor();
             rlutil::setColor(rlutil::GREY);
             cout << "[IceTea]: " << msg << endl;
@@ -275,6 +442,9 @@ IceTea* IceTea::setupCli(int argc, const char** argv) {
     this->bootstrapit = this->cli->value("-b");
     this->buildit = this->cli->value("-f");
     this->outputDir = this->cli->value("-d");
+    if(this->cli->check("--debug")) {
+        this->setDebug(true);
+    }
     this->cacheFile = create_filespec(this->outputDir, ".cache.it");
 
 
@@ -386,6 +556,62 @@ bool IceTea::hasEndedExecuting() {
     return hasEndedExecuting(dummy);
 }
 
+OS::String IceTea::getCompiledFilename(const String& resolved_filename, OS_ESourceCodeType type) {
+    if(scriptCache.empty()) {
+        return OS::getCompiledFilename(resolved_filename);
+    }
+    // Plain and automatic sources are tokenized the same way.
+    string path = resolved_filename.toChar();
+    string source = path + (type == OS_SOURCECODE_TEMPLATE ? "\ntemplate" : "\nplain");
+    time_t mtime = file_modified(path);
+    size_t size = file_size(path);
+    map<string, CompiledScript>::iterator known = compiledScripts.find(source);
+    if(known != compiledScripts.end() && known->second.mtime == mtime && known->second.size == size) {
+        return String(this, known->second.filename.c_str());
+    }
+    ifstream in(path.c_str(), ios::in | ios::binary);
+    if(!in) {
+        return OS::getCompiledFilename(resolved_filename);
+    }
+    // Everything that goes into the bytecode is part of the key: the
+    // interpreter and its bytecode version, the settings the compiler looks
+    // at, the path (for __FILE__ and __DIR__), the source code type and the
+    // source itself. The name starts with a hash of the path and type, which
+    // older entries share.
+    stringstream key;
+    key << OS_VERSION << " " << OS_BYTECODE_VERSION << "\n"
+        << ICETEA_VERSION << "\n"
+        << getSetting(OS_SETTING_COMPILE_DEBUG_CALLS)
+        << getSetting(OS_SETTING_CREATE_DEBUG_INFO) << "\n"
+        << source << "\n"
+        << in.rdbuf();
+    string prefix, hash;
+    picosha2::hash256_hex_string(source, prefix);
+    prefix = prefix.substr(0, 16) + "-";
+    picosha2::hash256_hex_string(key.str(), hash);
+    string filename = create_filespec(scriptCache, prefix + hash, "osc");
+    if(!file_exists(filename)) {
+        // The source changed, only its new bytecode is kept.
+        vector<string> old = folder_wildcard(scriptCache, prefix + "*.osc", false, true);
+        for(size_t i = 0; i < old.size(); i++) {
+            file_delete(create_filespec(scriptCache, old[i]));
+        }
+    }
+    CompiledScript& compiled = compiledScripts[source];
+    compiled.mtime = mtime;
+    compiled.size = size;
+    compiled.filename = filename;
+    return String(this, filename.c_str());
+}
+
+OS_EFileUseType IceTea::checkFileUsage(const String& sourcecode_filename, const String& compiled_filename) {
+    // A cached file is named after its source, so if it exists, it is current.
+    if(scriptCache.empty()) {
+        return OS::checkFileUsage(sourcecode_filename, compiled_filename);
+    }
+    return LOAD_COMPILED_FILE;
+}
+
 void IceTea::require(string file) {
     OS::require(file.c_str(), true, 0, OS_SOURCECODE_PLAIN, true, false);
 }
@@ -426,6 +652,15 @@ bool IceTea::startup() {
     this->cli->check("-p") && file_delete(this->cacheFile);
     this->fc = new Filecache(this->cacheFile);
 
+    // Compiled scripts
+    this->scriptCache = create_filespec(this->outputDir, ".bytecode");
+    this->cli->check("-p") && folder_delete(this->scriptCache, true);
+    if(folder_create(this->scriptCache) || folder_exists(this->scriptCache)) {
+        this->setSetting(OS_SETTING_CREATE_COMPILED_FILE, 1);
+    } else {
+        this->scriptCache.clear();
+    }
+
     // First, load the native modules.
     if(!this->initializeModules()) {
         // Something did not initiaize.
@@ -502,7 +737,7 @@ int IceTea::run() {
     }
 
     // If we came thus far, then we really want to configure, stack and run.
-    callObjectFunction(this, "IceTea", "Main");
+    callObjectFunction(this, "IceTea", "Main", 0, 1);
     if(this->hasEndedExecuting(rt)) {
         this->printDebug("Main failed.");
         return rt;
@@ -3,7 +3,9 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <fstream>
+#include <time.h>
 
 #include "objectscript.h"
 #include "cli.h"
@@ -40,6 +42,15 @@ private:
     string      buildit;    ///< Path to a build.it file. Required.
     string      outputDir;  ///< Path to the putput folder.
     string      cacheFile;  ///< Path to the file containing the cache.
+    string      scriptCache;///< Folder of compiled scripts. Empty if they are not cached.
+
+    // A source hashed already, it is hashed again once it changed on disk.
+    struct CompiledScript {
+        time_t      mtime;
+        size_t      size;
+        string      filename;
+    };
+    std::map<string, CompiledScript> compiledScripts; ///< By source code type and path.
     bool        shouldDebug;///< Should we print debug messages?
     Pluma       manager;    ///< Plugin manager
     ITPlugins   plugins;    ///< Internal storage of all loaded, compiled-in plugins.
@@ -50,6 +61,29 @@ private:
     // Initialize the various IceTea modules.
     bool initializeModules();
 
+    // A script compiled into the binary.
+    struct EmbeddedScript {
+        const char*             name;
+        const unsigned char*    script;
+        int                     len;
+    };
+
+    // Scripted modules that are evaluated when one of their globals is first used.
+    struct LazyModule {
+        std::vector<string>         globals;
+        std::vector<EmbeddedScript> scripts;
+        std::map<string, int>       natives;    ///< Globals a plugin made already, by value id.
+        bool                        loaded;
+    };
+    std::vector<LazyModule*> lazyModules;
+
+    // Replace the globals (NULL-terminated) by accessors that evaluate the scripts.
+    void addLazyModule(const char**, const EmbeddedScript*);
+    void addLazyAccessors(LazyModule*);
+    bool loadLazyModule(LazyModule*);
+    static int lazyGlobal(ObjectScript::OS*, int, int, int, void*);
+    static int lazySetGlobal(ObjectScript::OS*, int, int, int, void*);
+
 public:
 
     // Constructor and destructor
@@ -59,6 +93,10 @@ public:
 
     // Implementation of virtual methods
     void initSettings();
+    // Compiled scripts are kept in the output folder, named by a hash of their source.
+    using ObjectScript::OS::getCompiledFilename;
+    String getCompiledFilename(const String&, ObjectScript::OS_ESourceCodeType);
+    ObjectScript::OS_EFileUseType checkFileUsage(const String&, const String&);
 
     // Enable or disable debug.
     void setDebug(bool);
@@ -112,6 +150,10 @@ public:
     // Also creates the output folder and cache file!
     bool startup();
 
+    // Set up an interpreter for a worker thread: only the named plugins and
+    // std.os, no CLI, cache or bootstrap.it.
+    bool startupWorker(const std::vector<std::string>&);
+
     // Run the main code - building, installing or cleaning.
     void runMain(int&);
 
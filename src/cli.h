@@ -114,6 +114,8 @@ public:
 
         @note You need either shortopt or longopt - or both. But you can not leave both empty.
         @note Only if you supplied arg, you will be able to pull a value.
+        @note An arg written in brackets, like `[N]`, makes the value optional.
+              It is then only consumed if the next argument is a number.
     */
     inline void insert(
         std::string shortopt, std::string longopt,
@@ -176,6 +178,15 @@ public:
         return std::pair<std::string, int>("", -1);
     }
 
+    /// For core.
+    static bool isNumeric(const char* str) {
+        if(*str == '\0') return false;
+        for(; *str != '\0'; str++) {
+            if(*str < '0' || *str > '9') return false;
+        }
+        return true;
+    }
+
     /// Tell the instance to parse the given argc and argv.
     inline bool parse() {
         // This has to be done to avoid multiples if we parse multiple times.
@@ -184,12 +195,26 @@ public:
         std::pair<std::string, int> opt;
         for(argn=1; argn < argc; argn++) { /* Read command line. */
             opt = findOpt(argv[argn]);
+            std::string arg = argv[argn];
+            std::string::size_type eq = arg.find('=');
+            if(opt.second==-1 && arg.compare(0, 2, "--") == 0 && eq != std::string::npos) {
+                /* A longopt given as --name=value. */
+                opt = findOpt(arg.substr(0, eq));
+                if(opt.second!=-1 && !ga[opt.first][opt.second]->arg.empty()) {
+                    ga[opt.first][opt.second]->value = arg.substr(eq + 1);
+                    ga[opt.first][opt.second]->present = true;
+                    continue;
+                }
+                return false;
+            }
             if(opt.second!=-1) { /* This argument is an option switch. */
                 if(ga.find(opt.first)!=ga.end() && !ga[opt.first][opt.second]->arg.empty()) { /* It takes an argument. */
-                    if(argn + 1 < argc) {
+                    /* An argument written as [N] is optional and only taken if numeric. */
+                    bool optionalArg = ga[opt.first][opt.second]->arg[0] == '[';
+                    if(argn + 1 < argc && (!optionalArg || isNumeric(argv[argn+1]))) {
                         ga[opt.first][opt.second]->value = argv[argn+1]; /* Add next argument as the option value. */
                         argn++;
-                    } else return false;
+                    } else if(!optionalArg) return false;
                 }
                 ga[opt.first][opt.second]->present = true; /* Tell the option it exists. */
             } else if(argv[argn][0] == '-') /* Nonexistent option. */
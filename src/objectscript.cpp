@@ -27,7 +27,13 @@ using namespace ObjectScript;
 
 #define HASH_GROW_SHIFT 0
 
+#define OS_SHAPE_MAX_KEYS 32 // tables with more keys are dictionaries
+#define OS_SHAPE_MAX_COUNT 16384 // then new key orders make dictionaries
+
 #define OS_PTR_HASH(p) ((int)(intptr_t)(p) >> 2)
+// heads of dictionary tables are open addressed with double hashing
+#define OS_HEAD_STEP(hash) (((hash) >> 16) | 1)
+#define OS_DELETED_HEAD ((Property*)(intptr_t)1)
 
 #define Instruction OS_U32
 
@@ -135,11 +141,19 @@ static void checkFlagClear(int instruction, int flag)
 
 #endif // OS_MAX_GENERIC_CONST_INDEX == 0
 
+#ifdef OS_THREADED_DISPATCH
+// each handler also gets a label, see OS::Core::execute
+#define OS_CASE_OPCODE_ALL(opcode) case (opcode): opcode_label_##opcode
+#define OS_CASE_OPCODE(opcode) case (opcode): opcode_label_##opcode
+#else
 #define OS_CASE_OPCODE_ALL(opcode) case (opcode)
 #define OS_CASE_OPCODE(opcode) case (opcode)
+#endif
 
 #else // OS_USE_OPCODE_VV
 
+#undef OS_THREADED_DISPATCH
+
 /*
 ** size and position of opcode arguments.
 */
@@ -1774,6 +1788,7 @@ OS::Core::Tokenizer::InitOperators OS::Core::Tokenizer::init_operators = OS::Cor
 OS::Core::Tokenizer::TextData::TextData(OS * p_allocator): filename(p_allocator)
 {
 	allocator = p_allocator;
+	source_code_type = OS_SOURCECODE_AUTO;
 	ref_count = 1;
 }
 
@@ -1847,6 +1862,7 @@ bool OS::Core::Tokenizer::parseText(const OS_CHAR * text, int len, const String&
 
 	text_data->filename = filename;
 	text_data->is_real_file = is_real_file;
+	text_data->source_code_type = source_code_type;
 
 	allocator->vectorClear(text_data->lines);
 
@@ -4128,6 +4144,7 @@ bool OS::Core::Compiler::compile()
 	if(scope){
 		prog_strings_table = allocator->core->newTable(OS_DBG_FILEPOS_START);
 		prog_numbers_table = allocator->core->newTable(OS_DBG_FILEPOS_START);
+		allocator->core->unshapeTable(prog_strings_table); // a dictionary of every string of the program
 		
 		Expression * exp = postCompileExpression(scope, scope);
 		if(exp){
@@ -4155,8 +4172,13 @@ bool OS::Core::Compiler::compile()
 				saveToStream(&mem_writer);
 
 				if(!is_eval && allocator->core->settings.create_compiled_file){
-					OS::String compiled_filename = allocator->getCompiledFilename(filename);
-					FileStreamWriter(allocator, compiled_filename).writeBytes(mem_writer.buffer.buf, mem_writer.buffer.count);
+					OS::String compiled_filename = allocator->getCompiledFilename(filename, tokenizer->getTextData()->source_code_type);
+					// write aside and rename, so a compiled file is never seen half written
+					OS::String temp_filename = compiled_filename + OS_TEXT(".tmp");
+					FileStreamWriter(allocator, temp_filename).writeBytes(mem_writer.buffer.buf, mem_writer.buffer.count);
+					if(::rename(temp_filename.toChar(), compiled_filename.toChar()) != 0){
+						::remove(temp_filename.toChar());
+					}
 				}
 
 				Program * prog = new (malloc(sizeof(Program) OS_DBG_FILEPOS)) Program(allocator);
@@ -5071,6 +5093,16 @@ OS::Core::Compiler::Expression * OS::Core::Compiler::postCompilePass2(Scope * sc
 		{
 			OS_ASSERT(exp->list.count == 2);
 			exp->list[0] = postCompilePass2(scope, exp->list[0]);
+			if(!allocator->core->settings.compile_debug_calls && exp->ret_values <= 1
+				&& exp->list[0]->type == EXP_TYPE_GET_ENV_VAR
+				&& exp->list[0]->token->str == allocator->core->strings->func_debug)
+			{
+				// the arguments are never evaluated, so interpolated messages cost nothing
+				Expression * null_exp = new (malloc(sizeof(Expression) OS_DBG_FILEPOS)) Expression(exp->ret_values ? EXP_TYPE_CONST_NULL : EXP_TYPE_NOP, exp->token);
+				null_exp->ret_values = exp->ret_values;
+				allocator->deleteObj(exp);
+				return null_exp;
+			}
 			exp->list[1] = postCompilePass2(scope, exp->list[1]);
 			Expression * left_exp = exp->list[0];
 			Expression * right_exp = exp->list[1];
@@ -10757,6 +10789,7 @@ OS::Core::Program::Program(OS * allocator): filename(allocator)
 	this->allocator = allocator;
 	ref_count = 1;
 	const_values = NULL;
+	property_cache_slots = NULL;
 	num_numbers = 0;
 	num_strings = 0;
 }
@@ -10793,6 +10826,10 @@ OS::Core::Program::~Program()
 	allocator->free(functions);
 	functions = NULL;
 
+	allocator->free(property_cache_slots);
+	property_cache_slots = NULL;
+	allocator->vectorClear(property_caches);
+
 	allocator->vectorClear(opcodes);
 	allocator->vectorClear(debug_info);
 }
@@ -10804,6 +10841,7 @@ bool OS::Core::Compiler::saveToStream(StreamWriter * writer)
 	int i, len = (int)OS_STRLEN(OS_VERSION)+1;
 	writer->writeByte(len);
 	writer->writeBytes(OS_VERSION, len);
+	writer->writeUVariable(OS_BYTECODE_VERSION);
 
 	MemStreamWriter int_stream(allocator);
 	MemStreamWriter float_stream(allocator);
@@ -10923,6 +10961,9 @@ bool OS::Core::Program::loadFromStream(StreamReader * reader)
 	if(!reader->checkBytes(OS_VERSION, len)){
 		return false;
 	}
+	if(reader->readUVariable() != OS_BYTECODE_VERSION){
+		return false;
+	}
 
 	int int_count = reader->readUVariable();
 	int float_count = reader->readUVariable();
@@ -11650,7 +11691,11 @@ void OS::Core::MemStreamReader::movePos(int len)
 
 bool OS::Core::MemStreamReader::checkBytes(const void * src, int len)
 {
-	OS_ASSERT(getPos() >= 0 && getPos()+len <= size);
+	OS_ASSERT(getPos() >= 0);
+	if(getPos()+len > size){
+		// an empty or cut off file
+		return false;
+	}
 	bool r = OS_MEMCMP(cur, src, len) == 0;
 	cur += len;
 	return r;
@@ -11936,14 +11981,12 @@ inline std::size_t float_hash_value(T v)
 
 OS::Core::Property::Property(const Value& p_index, const Value& p_value): index(p_index), value(p_value)
 {
-	hash_next = NULL;
 	prev = NULL;
 	next = NULL;
 }
 
 OS::Core::Property::~Property()
 {
-	OS_ASSERT(!hash_next);
 	OS_ASSERT(!prev);
 	OS_ASSERT(!next);
 }
@@ -11967,16 +12010,40 @@ OS::Core::Table::Table()
 {
 	head_mask = 0;
 	heads = NULL;
+	head_deleted = 0;
 	next_index = 0;
 	count = 0;
 	first = last = NULL;
 	iterators = NULL;
+	has_accessors = false;
+	in_property_cache = false;
+	version = 0;
+	shape = NULL;
+	block = NULL;
+	block_size = 0;
+	chunks = NULL;
 }
 
 OS::Core::Table::~Table()
 {
 	OS_ASSERT(count == 0 && !first && !last && !iterators);
-	OS_ASSERT(!heads);
+	OS_ASSERT(!heads && !shape && !block && !chunks);
+}
+
+OS::Core::Property * OS::Core::Table::Chunk::getProperties()
+{
+	return (Property*)OS_STRUCT_OFFS(this, 1);
+}
+
+bool OS::Core::Table::isInBlock(Property * prop) const
+{
+	for(Chunk * chunk = chunks; chunk; chunk = chunk->next){
+		Property * props = chunk->getProperties();
+		if(prop >= props && prop < props + chunk->size){
+			return true;
+		}
+	}
+	return false;
 }
 
 bool OS::Core::Table::containsIterator(IteratorState * iter)
@@ -12023,12 +12090,213 @@ void OS::Core::Table::removeIterator(IteratorState * iter)
 
 OS::Core::Table * OS::Core::newTable(OS_DBG_FILEPOS_START_DECL)
 {
-	return new (malloc(sizeof(Table) OS_DBG_FILEPOS_PARAM)) Table();
+	Table * table = new (malloc(sizeof(Table) OS_DBG_FILEPOS_PARAM)) Table();
+	table->version = ++table_version_seq;
+	return table;
+}
+
+int OS::Core::Shape::find(const Value& index, int index_type) const
+{
+	if(index_type != OS_VALUE_TYPE_STRING){
+		return -1;
+	}
+	GCStringValue * string = OS_VALUE_VARIANT(index).string;
+	for(int i = string->hash & slot_mask;; i = (i+1) & slot_mask){
+		int slot = slots[i];
+		if(slot < 0 || OS_VALUE_VARIANT(keys[slot]).string == string){
+			return slot;
+		}
+	}
+}
+
+int OS::Core::Shape::getBlockSize() const
+{
+	// tables of this shape likely get the keys up to where the transitions branch
+	const Shape * shape = this;
+	while(shape->child){
+		shape = shape->child;
+	}
+	return shape->count;
+}
+
+OS::Core::Shape * OS::Core::getShapeTransition(Shape * parent, const Value& index)
+{
+	// the shape of a table with parent's keys and index added last
+	if(OS_VALUE_TYPE(index) != OS_VALUE_TYPE_STRING || (parent && parent->count >= OS_SHAPE_MAX_KEYS)){
+		return NULL;
+	}
+	GCStringValue * string = OS_VALUE_VARIANT(index).string;
+	int hash = OS_PTR_HASH(parent) ^ string->hash;
+	if(shapes){
+		for(Shape * shape = shapes[hash & shapes_head_mask]; shape; shape = shape->hash_next){
+			if(shape->parent == parent && OS_VALUE_VARIANT(shape->keys[shape->count-1]).string == string){
+				return shape;
+			}
+		}
+	}
+	if(shapes_count >= OS_SHAPE_MAX_COUNT){
+		return NULL;
+	}
+	if(shapes_count >= shapes_head_mask){
+		int new_size = shapes ? (shapes_head_mask+1) * 2 : 64;
+		Shape ** new_shapes = (Shape**)malloc(sizeof(Shape*) * new_size OS_DBG_FILEPOS);
+		OS_MEMSET(new_shapes, 0, sizeof(Shape*) * new_size);
+		for(int i = 0; shapes && i <= shapes_head_mask; i++){
+			for(Shape * shape = shapes[i], * next; shape; shape = next){
+				next = shape->hash_next;
+				int slot = (OS_PTR_HASH(shape->parent) ^ OS_VALUE_VARIANT(shape->keys[shape->count-1]).string->hash) & (new_size-1);
+				shape->hash_next = new_shapes[slot];
+				new_shapes[slot] = shape;
+			}
+		}
+		free(shapes);
+		shapes = new_shapes;
+		shapes_head_mask = new_size-1;
+	}
+
+	Shape * shape = (Shape*)malloc(sizeof(Shape) OS_DBG_FILEPOS);
+	shape->parent = parent;
+	shape->count = parent ? parent->count + 1 : 1;
+	shape->keys = (Value*)malloc(sizeof(Value) * shape->count OS_DBG_FILEPOS);
+	if(parent){
+		OS_MEMCPY(shape->keys, parent->keys, sizeof(Value) * parent->count);
+	}
+	shape->keys[shape->count-1] = index;
+	retainValues(shape->keys, shape->count);
+
+	int size = 4;
+	while(size < shape->count * 2){
+		size *= 2;
+	}
+	shape->slot_mask = size-1;
+	shape->slots = (int*)malloc(sizeof(int) * size OS_DBG_FILEPOS);
+	OS_MEMSET(shape->slots, -1, sizeof(int) * size);
+	for(int slot = 0; slot < shape->count; slot++){
+		int i = OS_VALUE_VARIANT(shape->keys[slot]).string->hash & shape->slot_mask;
+		while(shape->slots[i] >= 0){
+			i = (i+1) & shape->slot_mask;
+		}
+		shape->slots[i] = slot;
+	}
+	shape->child = NULL;
+	shape->branched = false;
+	if(parent){
+		if(parent->child || parent->branched){
+			parent->child = NULL;
+			parent->branched = true;
+		}else{
+			parent->child = shape;
+		}
+	}
+
+	shape->hash_next = shapes[hash & shapes_head_mask];
+	shapes[hash & shapes_head_mask] = shape;
+	shapes_count++;
+	return shape;
+}
+
+void OS::Core::unshapeTable(Table * table)
+{
+	// the table becomes a dictionary, its properties stay where they are
+	OS_ASSERT(!table->heads);
+	int new_size = 4;
+	while(new_size*3 < (table->count+1)*4){
+		new_size *= 2;
+	}
+	resizeTableHeads(table, new_size);
+	table->shape = NULL;
+}
+
+void OS::Core::growTableBlock(Table * table, int new_size)
+{
+	// the properties already there stay where they are, a new chunk holds the added slots
+	OS_ASSERT(table->shape || !table->block);
+	OS_ASSERT(new_size > table->block_size && table->count == table->block_size);
+	int added = new_size - table->block_size;
+	Table::Chunk * chunk = (Table::Chunk*)malloc(OS_HEAP_SIZE_ALIGN(sizeof(Table::Chunk)) + sizeof(Property) * added OS_DBG_FILEPOS);
+	chunk->next = table->chunks;
+	chunk->size = added;
+	table->chunks = chunk;
+
+	Property ** block = (Property**)malloc(sizeof(Property*) * new_size OS_DBG_FILEPOS);
+	if(table->block_size > 0){
+		OS_MEMCPY(block, table->block, sizeof(Property*) * table->block_size);
+	}
+	Property * props = chunk->getProperties();
+	for(int i = 0; i < added; i++){
+		block[table->block_size + i] = props + i;
+	}
+	free(table->block);
+	table->block = block;
+	table->block_size = new_size;
+}
+
+void OS::Core::resizeTableHeads(Table * table, int new_size)
+{
+	free(table->heads);
+	table->heads = (Property**)malloc(sizeof(Property*) * new_size OS_DBG_FILEPOS);
+	OS_MEMSET(table->heads, 0, sizeof(Property*) * new_size);
+	table->head_mask = new_size-1;
+	table->head_deleted = 0;
+	for(Property * cur = table->first; cur; cur = cur->next){
+		insertTableHead(table, cur);
+	}
+}
+
+void OS::Core::insertTableHead(Table * table, Property * prop)
+{
+	int hash = getValueHash(prop->index, OS_VALUE_TYPE(prop->index));
+	int step = OS_HEAD_STEP(hash), i = hash & table->head_mask;
+	for(; table->heads[i]; i = (i+step) & table->head_mask){
+		if(table->heads[i] == OS_DELETED_HEAD){
+			table->head_deleted--;
+			break;
+		}
+	}
+	table->heads[i] = prop;
+}
+
+void OS::Core::removeTableHead(Table * table, Property * prop)
+{
+	int hash = getValueHash(prop->index, OS_VALUE_TYPE(prop->index));
+	int step = OS_HEAD_STEP(hash), i = hash & table->head_mask;
+	for(; table->heads[i] != prop; i = (i+step) & table->head_mask){
+		OS_ASSERT(table->heads[i]);
+	}
+	// probes for other keys may pass this slot
+	table->heads[i] = OS_DELETED_HEAD;
+	table->head_deleted++;
+}
+
+void OS::Core::deleteShapes()
+{
+	for(int i = 0; shapes && i <= shapes_head_mask; i++){
+		for(Shape * shape = shapes[i], * next; shape; shape = next){
+			next = shape->hash_next;
+			releaseValues(shape->keys, shape->count);
+			free(shape->keys);
+			free(shape->slots);
+			free(shape);
+		}
+	}
+	free(shapes);
+	shapes = NULL;
+	shapes_head_mask = 0;
+	shapes_count = 0;
+}
+
+void OS::Core::tableChanged(Table * table)
+{
+	table->version = ++table_version_seq;
+	if(table->in_property_cache){
+		property_cache_epoch++;
+	}
 }
 
 void OS::Core::clearTable(Table * table)
 {
 	OS_ASSERT(table);
+	tableChanged(table);
 	Property * prop = table->last, * prev;
 
 	table->count = 0;
@@ -12037,13 +12305,14 @@ void OS::Core::clearTable(Table * table)
 
 	for(; prop; prop = prev){
 		prev = prop->prev;
-		prop->hash_next = NULL;
 		prop->prev = NULL;
 		prop->next = NULL;
 		releaseValue(prop->index);
 		releaseValue(prop->value);
 		prop->~Property();
-		free(prop);
+		if(!table->isInBlock(prop)){
+			free(prop);
+		}
 	}
 
 	while(table->iterators){
@@ -12054,7 +12323,17 @@ void OS::Core::clearTable(Table * table)
 	free(table->heads);
 	table->heads = NULL;
 	table->head_mask = 0;
+	table->head_deleted = 0;
 	table->next_index = 0;
+	free(table->block);
+	table->block = NULL;
+	table->block_size = 0;
+	while(table->chunks){
+		Table::Chunk * chunk = table->chunks;
+		table->chunks = chunk->next;
+		free(chunk);
+	}
+	table->shape = NULL;
 }
 
 void OS::Core::deleteTable(Table * table)
@@ -12069,50 +12348,47 @@ OS::Core::Property * OS::Core::addTableProperty(Table * table, const Value& inde
 {
 	OS_ASSERT(!table->get(index, OS_VALUE_TYPE(index)));
 
-	Property * prop = new (malloc(sizeof(Property) OS_DBG_FILEPOS)) Property(index, value);
+	Property * prop;
+	if(!table->heads){
+		Shape * shape = getShapeTransition(table->shape, index);
+		if(shape){
+			if(table->count == table->block_size){
+				growTableBlock(table, shape->getBlockSize());
+			}
+			prop = new (table->block[table->count]) Property(index, value);
+			retainValue(prop->index);
+			retainValue(prop->value);
+			table->shape = shape;
+			if(!table->first){
+				table->first = prop;
+			}else{
+				table->last->next = prop;
+				prop->prev = table->last;
+			}
+			table->last = prop;
+			table->count++;
+			tableChanged(table);
+			if(isAccessorName(prop->index)){
+				table->has_accessors = true;
+				accessor_epoch++;
+			}
+			return prop;
+		}
+		unshapeTable(table);
+	}
+
+	prop = new (malloc(sizeof(Property) OS_DBG_FILEPOS)) Property(index, value);
 	OS_ASSERT(prop->next == NULL);
 	
 	retainValue(prop->index);
 	retainValue(prop->value);
 
-	if((table->count>>HASH_GROW_SHIFT) >= table->head_mask){
-		int new_size = table->heads ? (table->head_mask+1) * 2 : 4;
-		int alloc_size = sizeof(Property*)*new_size;
-		Property ** new_heads = (Property**)malloc(alloc_size OS_DBG_FILEPOS);
-		OS_ASSERT(new_heads);
-		OS_MEMSET(new_heads, 0, alloc_size);
-
-		Property ** old_heads = table->heads;
-		table->heads = new_heads;
-		table->head_mask = new_size-1;
-
-		for(Property * cur = table->first; cur; cur = cur->next){
-			int type = OS_VALUE_TYPE(cur->index);
-#if 000
-			int hash;
-			OS_CALC_VALUE_HASH(cur->index, type);
-			int slot = hash & table->head_mask;
-#else
-			int slot = getValueHash(cur->index, type) & table->head_mask;
-#endif
-			cur->hash_next = table->heads[slot];
-			table->heads[slot] = cur;
-		}
-
-		// delete [] old_heads;
-		free(old_heads);
+	if((table->count + table->head_deleted + 1)*4 > (table->head_mask+1)*3){
+		// drop the deleted heads, grow if that is not enough
+		resizeTableHeads(table, (table->count+1)*2 > table->head_mask+1 ? (table->head_mask+1) * 2 : table->head_mask+1);
 	}
-
+	insertTableHead(table, prop);
 	int type = OS_VALUE_TYPE(prop->index);
-#if 000
-	int hash;
-	OS_CALC_VALUE_HASH(prop->index, type);
-	int slot = hash & table->head_mask;
-#else
-	int slot = getValueHash(prop->index, type) & table->head_mask;
-#endif
-	prop->hash_next = table->heads[slot];
-	table->heads[slot] = prop;
 
 	if(!table->first){
 		table->first = prop;    
@@ -12128,48 +12404,31 @@ OS::Core::Property * OS::Core::addTableProperty(Table * table, const Value& inde
 	}
 
 	table->count++;
+	tableChanged(table);
+
+	if(isAccessorName(prop->index)){
+		table->has_accessors = true;
+		accessor_epoch++;
+	}
 
 	return prop;
 }
 
 void OS::Core::changePropertyIndex(Table * table, Property * prop, const Value& new_index)
 {
-	int type = OS_VALUE_TYPE(prop->index);
-#if 000
-	int hash;
-	OS_CALC_VALUE_HASH(prop->index, type);
-	int slot = hash & table->head_mask;
-#else
-	int slot = getValueHash(prop->index, type) & table->head_mask;
-#endif
-	Property * cur = table->heads[slot], * chain_prev = NULL;
-	for(; cur; chain_prev = cur, cur = cur->hash_next){
-		if(cur == prop){ // cur->isEqual(index)){
-			if(chain_prev){
-				chain_prev->hash_next = cur->hash_next;
-			}else{
-				table->heads[slot] = cur->hash_next;
-			}
-			break;
-		}
+	if(!table->heads){
+		unshapeTable(table);
 	}
-	OS_ASSERT(cur && cur == prop);
-	if(cur){
-		// *prop = new_index;
-		setValue(prop->index, new_index);
-
-#if 000
-		OS_CALC_VALUE_HASH(prop->index, type);
-		slot = hash & table->head_mask;
-#else
-		slot = getValueHash(prop->index, type) & table->head_mask;
-#endif
-		prop->hash_next = table->heads[slot];
-		table->heads[slot] = prop;
-
-		if(type == OS_VALUE_TYPE_NUMBER && table->next_index <= OS_VALUE_NUMBER(prop->index)){
-			table->next_index = (OS_INT)OS_VALUE_NUMBER(prop->index) + 1;
-		}
+	removeTableHead(table, prop);
+	setValue(prop->index, new_index);
+	insertTableHead(table, prop);
+	tableChanged(table);
+	if(isAccessorName(new_index)){
+		table->has_accessors = true;
+		accessor_epoch++;
+	}
+	if(OS_VALUE_TYPE(new_index) == OS_VALUE_TYPE_NUMBER && table->next_index <= OS_VALUE_NUMBER(new_index)){
+		table->next_index = (OS_INT)OS_VALUE_NUMBER(new_index) + 1;
 	}
 }
 
@@ -12202,66 +12461,57 @@ bool OS::Core::deleteTableProperty(Table * table, const Value& index)
 {
 	OS_ASSERT(table);
 	int type = OS_VALUE_TYPE(index);
-#if 000
-	int hash;
-	OS_CALC_VALUE_HASH(index, type);
-	int slot = hash & table->head_mask;
-#else
-	int slot = getValueHash(index, type) & table->head_mask;
-#endif
-	Property * cur = table->heads[slot], * chain_prev = NULL;
-	for(; cur; chain_prev = cur, cur = cur->hash_next){
-		// if(isEqualExactly(cur->index, index)){
-		// performance optimization
-		if(OS_EQUAL_EXACTLY_BY_SAVED_TYPE(type, index, cur->index)){
-			if(table->first == cur){
-				table->first = cur->next;
-				if(table->first){
-					table->first->prev = NULL;
-				}
-			}else{
-				OS_ASSERT(cur->prev);
-				cur->prev->next = cur->next;
-			}
+	Property * cur = table->get(index, type);
+	if(!cur){
+		return false;
+	}
+	if(!table->heads){
+		// properties stay in place
+		unshapeTable(table);
+	}
+	if(table->first == cur){
+		table->first = cur->next;
+		if(table->first){
+			table->first->prev = NULL;
+		}
+	}else{
+		OS_ASSERT(cur->prev);
+		cur->prev->next = cur->next;
+	}
 
-			if(table->last == cur){
-				table->last = cur->prev;
-				if(table->last){
-					table->last->next = NULL;
-				}
-			}else{
-				OS_ASSERT(cur->next);
-				cur->next->prev = cur->prev;
-			}
+	if(table->last == cur){
+		table->last = cur->prev;
+		if(table->last){
+			table->last->next = NULL;
+		}
+	}else{
+		OS_ASSERT(cur->next);
+		cur->next->prev = cur->prev;
+	}
 
-			if(chain_prev){
-				chain_prev->hash_next = cur->hash_next;
-			}else{
-				table->heads[slot] = cur->hash_next;
-			}
+	removeTableHead(table, cur);
 
-			for(Table::IteratorState * iter = table->iterators; iter; iter = iter->next){
-				if(iter->prop == cur){
-					iter->prop = iter->ascending ? cur->next : cur->prev;
-				}
-			}
+	for(Table::IteratorState * iter = table->iterators; iter; iter = iter->next){
+		if(iter->prop == cur){
+			iter->prop = iter->ascending ? cur->next : cur->prev;
+		}
+	}
 
-			cur->next = NULL;
-			cur->prev = NULL;
-			cur->hash_next = NULL;
-			// cur->value.clear();
+	cur->next = NULL;
+	cur->prev = NULL;
+	// cur->value.clear();
 
-			releaseValue(cur->index);
-			releaseValue(cur->value);
+	releaseValue(cur->index);
+	releaseValue(cur->value);
 
-			table->count--;
+	table->count--;
+	tableChanged(table);
 
-			cur->~Property();
-			free(cur);
-			return true;
-		}
-	}  
-	return false;
+	cur->~Property();
+	if(!table->isInBlock(cur)){
+		free(cur);
+	}
+	return true;
 }
 
 void OS::Core::deleteValueProperty(GCValue * table_value, Value index, bool del_enabled, bool prototype_enabled)
@@ -12408,21 +12658,17 @@ void OS::Core::sortTable(Table * table, int(*comp)(OS*, const void*, const void*
 		table->last = props[i-1];
 
 		if(reorder_keys){
+			tableChanged(table);
+			if(!table->heads){
+				unshapeTable(table);
+			}
 #if 1 // performance optimization
 			OS_MEMSET(table->heads, 0, sizeof(Property*)*(table->head_mask+1));
+			table->head_deleted = 0;
 			for(i = 0; i < table->count; i++){
 				Property * cur = props[i];
 				setValue(cur->index, Value(i));
-				int type = OS_VALUE_TYPE(cur->index);
-#if 000
-				int hash;
-				OS_CALC_VALUE_HASH(cur->index, type);
-				int slot = hash & table->head_mask;
-#else
-				int slot = getValueHash(cur->index, type) & table->head_mask;
-#endif
-				cur->hash_next = table->heads[slot];
-				table->heads[slot] = cur;
+				insertTableHead(table, cur);
 			}
 #else
 			for(i = 0; i < table->count; i++){
@@ -12563,17 +12809,19 @@ int OS::Core::compareUserReverse(OS * os, const void * a, const void * b, void *
 
 OS::Core::Property * OS::Core::Table::get(const Value& index, int type)
 {
+	if(shape){
+		int slot = shape->find(index, type);
+		return slot >= 0 ? block[slot] : NULL;
+	}
 	if(heads){
 		OS_ASSERT(OS_VALUE_TYPE(index) == type);
-#if 000
-		int hash;
-		OS_CALC_VALUE_HASH(index, type);
-		Property * cur = heads[hash & head_mask];
-#else
-		Property * cur = heads[getValueHash(index, type) & head_mask];
-#endif
-		for(; cur; cur = cur->hash_next){
-			if(OS_EQUAL_EXACTLY_BY_SAVED_TYPE(type, index, cur->index)){
+		int hash = getValueHash(index, type);
+		for(int step = OS_HEAD_STEP(hash), i = hash & head_mask;; i = (i+step) & head_mask){
+			Property * cur = heads[i];
+			if(!cur){
+				break;
+			}
+			if(cur != OS_DELETED_HEAD && OS_EQUAL_EXACTLY_BY_SAVED_TYPE(type, index, cur->index)){
 				return cur;
 			}
 		}
@@ -12826,6 +13074,7 @@ OS::Core::GCValue::GCValue()
 	type = OS_VALUE_TYPE_NULL;
 	// is_object_instance = false;
 	is_destructor_called = false;
+	is_accessor_cached = false;
 }
 
 OS::Core::GCValue::~GCValue()
@@ -13862,6 +14111,33 @@ OS::Core::GCValue * OS::Core::FreeCandidateValues::get(int value_id)
 	return NULL;
 }
 
+#if defined _WIN32 && !defined IW_SDK
+#include <windows.h>
+#elif !defined CLOCK_MONOTONIC
+#include <sys/time.h>
+#endif
+
+double OS::getTimeSec()
+{
+#if defined _WIN32 && !defined IW_SDK
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	if(!freq.QuadPart){
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#elif defined CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+#endif
+}
+
 void OS::Core::gcFreeCandidateValues(bool full)
 {
 	if(!full && ((num_created_values+1) & 255)){
@@ -14167,7 +14443,9 @@ void OS::Core::gcFreeCandidateValues(bool full)
 
 	int used_bytes = allocator->getUsedBytes();
 	if(full || used_bytes >= gc_next_when_used_bytes){		
+		double start_time = OS::getTimeSec();
 		lib.gc_step_type = ++gc_step_type;
+		gc_cycles++;
 
 		lib.mark(global_vars);
 		lib.mark(user_pool);
@@ -14192,6 +14470,20 @@ void OS::Core::gcFreeCandidateValues(bool full)
 		for(i = 0; i < call_stack_funcs.count; i++){
 			lib.mark(&call_stack_funcs[i]);
 		}
+		lib.mark(yield_value);
+		for(i = 0; shapes && i <= shapes_head_mask; i++){
+			for(Shape * shape = shapes[i]; shape; shape = shape->hash_next){
+				lib.mark(shape->keys[shape->count-1]);
+			}
+		}
+		for(Coroutine * co = coroutines; co; co = co->next){
+			for(int j = 0; j < co->values.count; j++){
+				lib.mark(co->values[j]);
+			}
+			for(int j = 0; j < co->frames.count; j++){
+				lib.mark(&co->frames[j]);
+			}
+		}
 
 #if 1
 		head_mask = gc_candidate_values.head_mask;
@@ -14288,12 +14580,18 @@ void OS::Core::gcFreeCandidateValues(bool full)
 		gc_fix_in_progress = false;
 		// lib.destroyValues(false);
 		used_bytes = allocator->getUsedBytes();
-		if(used_bytes >= gc_next_when_used_bytes){
-			gc_next_when_used_bytes *= 2;
-		}else if(1){
-			while(used_bytes < gc_next_when_used_bytes/2 && gc_next_when_used_bytes/2 >= gc_start_when_used_bytes){
-				gc_next_when_used_bytes /= 2;
-			}
+		// pace by what survived, a big long-lived heap is traversed again
+		// only after it grew by the same share, not whenever it nears a fixed step
+		double next_bytes = (double)used_bytes * gc_pause / 100;
+		if(next_bytes < gc_start_when_used_bytes){
+			gc_next_when_used_bytes = gc_start_when_used_bytes;
+		}else{
+			gc_next_when_used_bytes = next_bytes < 0x7fffffff ? (int)next_bytes : 0x7fffffff;
+		}
+		gc_last_pause = OS::getTimeSec() - start_time;
+		gc_total_time += gc_last_pause;
+		if(gc_max_pause < gc_last_pause){
+			gc_max_pause = gc_last_pause;
 		}
 #if 0
 		if(0 && full){
@@ -14727,70 +15025,636 @@ void OS::Core::appendQuotedString(Buffer& buf, const String& string)
 	buf += OS_TEXT("\"");
 }
 
-// =====================================================================
-// =====================================================================
-// =====================================================================
+void OS::Core::appendValueString(Buffer& buf, const Value& val)
+{
+	switch(OS_VALUE_TYPE(val)){
+	case OS_VALUE_TYPE_NUMBER:
+		{
+			OS_CHAR str[128];
+			Utils::numToStr(str, (OS_FLOAT)OS_VALUE_NUMBER(val));
+			buf.append(str);
+			return;
+		}
 
-OS::Core::Strings::Strings(OS * allocator)
-	:
-	__construct(allocator, OS_TEXT("__construct")),
-	__destruct(allocator, OS_TEXT("__destruct")),
-	__instantiable(allocator, OS_TEXT("__instantiable")),
-	__newinstance(allocator, OS_TEXT("__newinstance")),
-	__callinstance(allocator, OS_TEXT("__callinstance")),
-	__object(allocator, OS_TEXT("__object")),
-	__get(allocator, OS_TEXT("__get")),
-	__set(allocator, OS_TEXT("__set")),
-	__isset(allocator, OS_TEXT("__isset")),
-	__getAt(allocator, OS_TEXT("__get@")),
-	__setAt(allocator, OS_TEXT("__set@")),
-	__issetAt(allocator, OS_TEXT("__isset@")),
-	__del(allocator, OS_TEXT("__del")),
-	__delAt(allocator, OS_TEXT("__del@")),
-	__getempty(allocator, OS_TEXT("__getempty")),
-	__setempty(allocator, OS_TEXT("__setempty")),
-	__delempty(allocator, OS_TEXT("__delempty")),
-	__getdim(allocator, OS_TEXT("__getdim")),
-	__setdim(allocator, OS_TEXT("__setdim")),
-	__deldim(allocator, OS_TEXT("__deldim")),
-	__iter(allocator, OS_TEXT("__iter")),
-	
-	__cmp(allocator, OS_TEXT("__cmp")),
-	__bitand(allocator, OS_TEXT("__bitand")),
-	__bitor(allocator, OS_TEXT("__bitor")),
-	__bitxor(allocator, OS_TEXT("__bitxor")),
-	__bitnot(allocator, OS_TEXT("__bitnot")),
-	__plus(allocator, OS_TEXT("__plus")),
-	__minus(allocator, OS_TEXT("__minus")),
-	__len(allocator, OS_TEXT("__len")),
-	__add(allocator, OS_TEXT("__add")),
-	__sub(allocator, OS_TEXT("__sub")),
-	__mul(allocator, OS_TEXT("__mul")),
-	__div(allocator, OS_TEXT("__div")),
-	__mod(allocator, OS_TEXT("__mod")),
-	__lshift(allocator, OS_TEXT("__lshift")),
-	__rshift(allocator, OS_TEXT("__rshift")),
-	__pow(allocator, OS_TEXT("__pow")),
-	
-	__rcmp(allocator, OS_TEXT("__rcmp")),
-	__rbitand(allocator, OS_TEXT("__rbitand")),
-	__rbitor(allocator, OS_TEXT("__rbitor")),
-	__rbitxor(allocator, OS_TEXT("__rbitxor")),
-	__radd(allocator, OS_TEXT("__radd")),
-	__rsub(allocator, OS_TEXT("__rsub")),
-	__rmul(allocator, OS_TEXT("__rmul")),
-	__rdiv(allocator, OS_TEXT("__rdiv")),
-	__rmod(allocator, OS_TEXT("__rmod")),
-	__rlshift(allocator, OS_TEXT("__rlshift")),
-	__rrshift(allocator, OS_TEXT("__rrshift")),
-	__rpow(allocator, OS_TEXT("__rpow")),
-	
-	func_unhandledException(allocator, OS_TEXT("unhandledException")),
-	func_getFilename(allocator, OS_TEXT("__getfilename")),
-	func_getDirname(allocator, OS_TEXT("__getdirname")),
-	func_extends(allocator, OS_TEXT("__extends")),
-	func_delete(allocator, OS_TEXT("__delete")),
-	func_length(allocator, OS_TEXT("__length")),
+	case OS_VALUE_TYPE_STRING:
+		OS_ASSERT(dynamic_cast<GCStringValue*>(OS_VALUE_VARIANT(val).string));
+		buf.append((const void*)OS_VALUE_VARIANT(val).string->toChar(), OS_VALUE_VARIANT(val).string->getDataSize());
+		return;
+	}
+	buf.append(valueToString(val, true));
+}
+
+void OS::Core::appendJoined(Buffer& buf, const Value& list, const String& separator)
+{
+	switch(OS_VALUE_TYPE(list)){
+	case OS_VALUE_TYPE_ARRAY:
+		{
+			OS_ASSERT(dynamic_cast<GCArrayValue*>(OS_VALUE_VARIANT(list).arr));
+			GCArrayValue * arr = OS_VALUE_VARIANT(list).arr;
+			if(arr->values.count < 1){
+				return;
+			}
+			// grow once for the usual list of strings
+			int size = buf.buffer.count + separator.getDataSize() * (arr->values.count - 1);
+			for(int i = 0; i < arr->values.count; i++){
+				if(OS_VALUE_TYPE(arr->values[i]) == OS_VALUE_TYPE_STRING){
+					size += OS_VALUE_VARIANT(arr->values[i]).string->getDataSize();
+				}
+			}
+			buf.reserveCapacity(size);
+			// valueOf methods may change the array, so count is read every time
+			for(int i = 0; i < arr->values.count; i++){
+				if(i > 0){
+					buf.append(separator);
+				}
+				appendValueString(buf, arr->values[i]);
+			}
+			return;
+		}
+
+	case OS_VALUE_TYPE_OBJECT:
+	case OS_VALUE_TYPE_USERDATA:
+	case OS_VALUE_TYPE_USERPTR:
+	case OS_VALUE_TYPE_FUNCTION:
+	case OS_VALUE_TYPE_CFUNCTION:
+		if(OS_VALUE_VARIANT(list).object->table){
+			Property * prop = OS_VALUE_VARIANT(list).object->table->first;
+			for(int i = 0; prop; prop = prop->next, i++){
+				if(i > 0){
+					buf.append(separator);
+				}
+				appendValueString(buf, prop->value);
+			}
+		}
+		return;
+	}
+}
+
+void OS::Core::appendJsonString(Buffer& buf, const OS_CHAR * str, int len)
+{
+	buf.append(OS_TEXT('\"'));
+	const OS_CHAR * end = str + len, * run = str;
+	for(; str < end; str++){
+		OS_BYTE c = (OS_BYTE)*str;
+		if(c >= OS_TEXT(' ') && c != OS_TEXT('\"') && c != OS_TEXT('\\')){
+			continue;
+		}
+		if(run < str){
+			buf.append(run, (int)(str - run));
+		}
+		run = str + 1;
+		switch(c){
+		case OS_TEXT('\"'): buf += OS_TEXT("\\\""); continue;
+		case OS_TEXT('\\'): buf += OS_TEXT("\\\\"); continue;
+		case OS_TEXT('\r'): buf += OS_TEXT("\\r"); continue;
+		case OS_TEXT('\n'): buf += OS_TEXT("\\n"); continue;
+		case OS_TEXT('\t'): buf += OS_TEXT("\\t"); continue;
+		case OS_TEXT('\b'): buf += OS_TEXT("\\b"); continue;
+		case OS_TEXT('\f'): buf += OS_TEXT("\\f"); continue;
+		}
+		buf += OS_TEXT("\\u00");
+		buf.append(DIGITS[(c >> 4) & 0xF]);
+		buf.append(DIGITS[c & 0xF]);
+	}
+	if(run < end){
+		buf.append(run, (int)(end - run));
+	}
+	buf.append(OS_TEXT('\"'));
+}
+
+OS::String OS::encodeJsonString(const OS_CHAR * str, int len)
+{
+	Core::Buffer buf(this);
+	core->appendJsonString(buf, str, len);
+	return buf.toStringOS();
+}
+
+void OS::Core::appendJson(Buffer& buf, const Value& val, bool custom_enabled)
+{
+	struct Writer
+	{
+		Core * core;
+		Buffer& buf;
+		String name;
+		Value builtin;
+
+		// toJson methods other than Object.toJson return the text of their value
+		bool writeCustom(const Value& val)
+		{
+			Value func;
+			if(!core->getPropertyValue(func, val, Value(name), true) || Core::isEqualExactly(func, builtin)
+				|| (OS_VALUE_TYPE(func) != OS_VALUE_TYPE_FUNCTION && OS_VALUE_TYPE(func) != OS_VALUE_TYPE_CFUNCTION))
+			{
+				return false;
+			}
+			core->pushValue(func);
+			core->pushValue(val);
+			core->callFT(0, 1, OS_CALLTYPE_FUNC);
+			buf += core->allocator->popString();
+			return true;
+		}
+
+		void writeNumber(OS_FLOAT num)
+		{
+			if(num != num || num - num != 0){
+				buf += OS_TEXT("null"); // NaN and infinity
+				return;
+			}
+			OS_CHAR str[128];
+			Utils::numToStr(str, num);
+			buf += str;
+		}
+
+		void write(const Value& val, bool custom_enabled)
+		{
+			switch(OS_VALUE_TYPE(val)){
+			default:
+				buf += OS_TEXT("null");
+				return;
+
+			case OS_VALUE_TYPE_BOOL:
+				buf += OS_VALUE_VARIANT(val).boolean ? OS_TEXT("true") : OS_TEXT("false");
+				return;
+
+			case OS_VALUE_TYPE_NUMBER:
+				writeNumber((OS_FLOAT)OS_VALUE_NUMBER(val));
+				return;
+
+			case OS_VALUE_TYPE_STRING:
+				OS_ASSERT(dynamic_cast<GCStringValue*>(OS_VALUE_VARIANT(val).string));
+				core->appendJsonString(buf, OS_VALUE_VARIANT(val).string->toChar(), OS_VALUE_VARIANT(val).string->getLen());
+				return;
+
+			case OS_VALUE_TYPE_ARRAY:
+			case OS_VALUE_TYPE_OBJECT:
+			case OS_VALUE_TYPE_USERDATA:
+			case OS_VALUE_TYPE_USERPTR:
+				break;
+			}
+			if(custom_enabled && writeCustom(val)){
+				return;
+			}
+			if(!core->pushValueOfRecursion(val)){
+				buf += OS_TEXT("null");
+				return;
+			}
+			struct Finalizer {
+				Core * core;
+				Value val;
+				~Finalizer(){ core->popValueOfRecursion(val); }
+			} finalizer = {core, val}; (void)finalizer;
+
+			if(OS_VALUE_TYPE(val) == OS_VALUE_TYPE_ARRAY){
+				OS_ASSERT(dynamic_cast<GCArrayValue*>(OS_VALUE_VARIANT(val).arr));
+				GCArrayValue * arr = OS_VALUE_VARIANT(val).arr;
+				buf.append(OS_TEXT('['));
+				for(int i = 0; i < arr->values.count && !core->allocator->isExceptionSet(); i++){
+					if(i > 0){
+						buf.append(OS_TEXT(','));
+					}
+					write(arr->values[i], true);
+				}
+				buf.append(OS_TEXT(']'));
+				return;
+			}
+			OS_ASSERT(dynamic_cast<GCValue*>(OS_VALUE_VARIANT(val).value));
+			GCValue * self = OS_VALUE_VARIANT(val).value;
+			buf.append(OS_TEXT('{'));
+			Property * prop = self->table ? self->table->first : NULL;
+			for(bool first = true; prop && !core->allocator->isExceptionSet(); prop = prop->next){
+				OS_CHAR str[128];
+				switch(OS_VALUE_TYPE(prop->index)){
+				case OS_VALUE_TYPE_NUMBER:
+					Utils::numToStr(str, (OS_FLOAT)OS_VALUE_NUMBER(prop->index));
+					if(!first) buf.append(OS_TEXT(','));
+					core->appendJsonString(buf, str, (int)OS_STRLEN(str));
+					break;
+
+				case OS_VALUE_TYPE_STRING:
+					if(!first) buf.append(OS_TEXT(','));
+					core->appendJsonString(buf, OS_VALUE_VARIANT(prop->index).string->toChar(), OS_VALUE_VARIANT(prop->index).string->getLen());
+					break;
+
+				default:
+					// skip value
+					continue;
+				}
+				first = false;
+				buf.append(OS_TEXT(':'));
+				write(prop->value, true);
+			}
+			buf.append(OS_TEXT('}'));
+		}
+	} writer = {this, buf, String(allocator, OS_TEXT("toJson"))};
+	getPropertyValue(writer.builtin, prototypes[PROTOTYPE_OBJECT], Value(writer.name), false);
+	writer.write(val, custom_enabled);
+}
+
+bool OS::Core::pushJsonValue(const OS_CHAR * str, int len)
+{
+	struct Parser
+	{
+		enum { MAX_DEPTH = 512 };
+
+		Core * core;
+		const OS_CHAR * start;
+		const OS_CHAR * cur;
+		const OS_CHAR * end;
+		const OS_CHAR * error;
+		int depth;
+		Buffer chars;
+
+		bool fail(const OS_CHAR * msg)
+		{
+			if(!error){
+				error = msg;
+			}
+			return false;
+		}
+
+		void skipSpaces()
+		{
+			while(cur < end && (*cur == OS_TEXT(' ') || *cur == OS_TEXT('\n') || *cur == OS_TEXT('\r') || *cur == OS_TEXT('\t'))){
+				cur++;
+			}
+		}
+
+		bool skipDigits()
+		{
+			const OS_CHAR * digits = cur;
+			while(cur < end && *cur >= OS_TEXT('0') && *cur <= OS_TEXT('9')){
+				cur++;
+			}
+			return cur > digits;
+		}
+
+		bool parseWord(const OS_CHAR * word, int len)
+		{
+			if(end - cur < len || OS_MEMCMP(cur, word, len * sizeof(OS_CHAR)) != 0){
+				return fail(OS_TEXT("unexpected character"));
+			}
+			cur += len;
+			return true;
+		}
+
+		bool parseNumber()
+		{
+			const OS_CHAR * num = cur;
+			if(*cur == OS_TEXT('-')){
+				cur++;
+			}
+			if(cur < end && *cur == OS_TEXT('0')){
+				cur++;
+			}else if(!skipDigits()){
+				return fail(OS_TEXT("invalid number"));
+			}
+			if(cur < end && *cur == OS_TEXT('.')){
+				cur++;
+				if(!skipDigits()) return fail(OS_TEXT("invalid number"));
+			}
+			if(cur < end && (*cur == OS_TEXT('e') || *cur == OS_TEXT('E'))){
+				cur++;
+				if(cur < end && (*cur == OS_TEXT('+') || *cur == OS_TEXT('-'))) cur++;
+				if(!skipDigits()) return fail(OS_TEXT("invalid number"));
+			}
+			bool negative = *num == OS_TEXT('-');
+			const OS_CHAR * digits = num + negative;
+			if(cur - digits <= 15){ // exact integer, the usual case
+				OS_FLOAT val = 0;
+				for(; digits < cur && *digits >= OS_TEXT('0') && *digits <= OS_TEXT('9'); digits++){
+					val = val * 10 + (*digits - OS_TEXT('0'));
+				}
+				if(digits == cur){
+					core->pushNumber(negative ? -val : val);
+					return true;
+				}
+			}
+			// correctly rounded, IceTea never leaves the C locale
+			chars.clear();
+			chars.append(num, (int)(cur - num));
+			chars.append(OS_TEXT('\0'));
+			core->pushNumber((OS_FLOAT)strtod((const char*)chars.buffer.buf, NULL));
+			return true;
+		}
+
+		int parseHex4()
+		{
+			if(end - cur < 4){
+				return -1;
+			}
+			int code = 0;
+			for(int i = 0; i < 4; i++, cur++){
+				OS_CHAR c = *cur;
+				code <<= 4;
+				if(c >= OS_TEXT('0') && c <= OS_TEXT('9')) code |= c - OS_TEXT('0');
+				else if(c >= OS_TEXT('a') && c <= OS_TEXT('f')) code |= c - OS_TEXT('a') + 10;
+				else if(c >= OS_TEXT('A') && c <= OS_TEXT('F')) code |= c - OS_TEXT('A') + 10;
+				else return -1;
+			}
+			return code;
+		}
+
+		void appendUtf8(int code)
+		{
+			if(code < 0x80){
+				chars.append((OS_CHAR)code);
+			}else if(code < 0x800){
+				chars.append((OS_CHAR)(0xC0 | (code >> 6)));
+				chars.append((OS_CHAR)(0x80 | (code & 0x3F)));
+			}else if(code < 0x10000){
+				chars.append((OS_CHAR)(0xE0 | (code >> 12)));
+				chars.append((OS_CHAR)(0x80 | ((code >> 6) & 0x3F)));
+				chars.append((OS_CHAR)(0x80 | (code & 0x3F)));
+			}else{
+				chars.append((OS_CHAR)(0xF0 | (code >> 18)));
+				chars.append((OS_CHAR)(0x80 | ((code >> 12) & 0x3F)));
+				chars.append((OS_CHAR)(0x80 | ((code >> 6) & 0x3F)));
+				chars.append((OS_CHAR)(0x80 | (code & 0x3F)));
+			}
+		}
+
+		// pushes the string starting at the opening quote
+		bool parseString()
+		{
+			const OS_CHAR * run = ++cur;
+			while(cur < end && *cur != OS_TEXT('\"') && *cur != OS_TEXT('\\') && (OS_BYTE)*cur >= OS_TEXT(' ')){
+				cur++;
+			}
+			if(cur < end && *cur == OS_TEXT('\"')){
+				core->pushStringValue(run, (int)(cur++ - run));
+				return true;
+			}
+			chars.clear();
+			for(;;){
+				if(cur > run){
+					chars.append(run, (int)(cur - run));
+				}
+				if(cur >= end){
+					return fail(OS_TEXT("unterminated string"));
+				}
+				if(*cur == OS_TEXT('\"')){
+					cur++;
+					break;
+				}
+				if(*cur != OS_TEXT('\\')){
+					return fail(OS_TEXT("control character in string"));
+				}
+				if(++cur >= end){
+					return fail(OS_TEXT("unterminated string"));
+				}
+				switch(*cur++){
+				case OS_TEXT('\"'): chars.append(OS_TEXT('\"')); break;
+				case OS_TEXT('\\'): chars.append(OS_TEXT('\\')); break;
+				case OS_TEXT('/'): chars.append(OS_TEXT('/')); break;
+				case OS_TEXT('b'): chars.append(OS_TEXT('\b')); break;
+				case OS_TEXT('f'): chars.append(OS_TEXT('\f')); break;
+				case OS_TEXT('n'): chars.append(OS_TEXT('\n')); break;
+				case OS_TEXT('r'): chars.append(OS_TEXT('\r')); break;
+				case OS_TEXT('t'): chars.append(OS_TEXT('\t')); break;
+				case OS_TEXT('u'):
+					{
+						int code = parseHex4();
+						if(code < 0){
+							return fail(OS_TEXT("invalid \\u escape"));
+						}
+						if(code >= 0xD800 && code < 0xDC00 && end - cur >= 6 && cur[0] == OS_TEXT('\\') && cur[1] == OS_TEXT('u')){
+							const OS_CHAR * high = cur;
+							cur += 2;
+							int low = parseHex4();
+							if(low >= 0xDC00 && low < 0xE000){
+								code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+							}else{
+								cur = high; // lone surrogate, the next escape stands alone
+							}
+						}
+						appendUtf8(code);
+						break;
+					}
+				default:
+					cur--;
+					return fail(OS_TEXT("invalid escape in string"));
+				}
+				run = cur;
+				while(cur < end && *cur != OS_TEXT('\"') && *cur != OS_TEXT('\\') && (OS_BYTE)*cur >= OS_TEXT(' ')){
+					cur++;
+				}
+			}
+			core->pushStringValue(chars.buffer.buf, chars.buffer.count);
+			return true;
+		}
+
+		bool parseArray()
+		{
+			GCArrayValue * arr = core->pushArrayValue();
+			cur++;
+			skipSpaces();
+			if(cur < end && *cur == OS_TEXT(']')){
+				cur++;
+				return true;
+			}
+			for(;;){
+				if(!parseValue()){
+					return false;
+				}
+				Value val = core->stack_values.lastElement();
+				core->retainValue(val);
+				core->allocator->vectorAddItem(arr->values, val OS_DBG_FILEPOS);
+				core->pop();
+				skipSpaces();
+				if(cur < end && *cur == OS_TEXT(',')){
+					cur++;
+					continue;
+				}
+				if(cur < end && *cur == OS_TEXT(']')){
+					cur++;
+					return true;
+				}
+				return fail(cur < end ? OS_TEXT("expected ',' or ']'") : OS_TEXT("unterminated array"));
+			}
+		}
+
+		bool parseObject()
+		{
+			GCObjectValue * obj = core->pushObjectValue();
+			cur++;
+			skipSpaces();
+			if(cur < end && *cur == OS_TEXT('}')){
+				cur++;
+				return true;
+			}
+			for(;;){
+				skipSpaces();
+				if(cur >= end || *cur != OS_TEXT('\"')){
+					return fail(cur < end ? OS_TEXT("expected string key") : OS_TEXT("unterminated object"));
+				}
+				if(!parseString()){
+					return false;
+				}
+				skipSpaces();
+				if(cur >= end || *cur != OS_TEXT(':')){
+					return fail(OS_TEXT("expected ':'"));
+				}
+				cur++;
+				if(!parseValue()){
+					return false;
+				}
+				// plain store: keys of the input never reach setters or the prototype
+				Value key = core->stack_values[core->stack_values.count-2];
+				Value val = core->stack_values[core->stack_values.count-1];
+				if(!obj->table){
+					obj->table = core->newTable(OS_DBG_FILEPOS_START);
+				}
+				Property * prop = obj->table->get(key, OS_VALUE_TYPE_STRING);
+				if(prop){
+					core->setValue(prop->value, val);
+				}else{
+					core->addTableProperty(obj->table, key, val);
+				}
+				core->pop(2);
+				skipSpaces();
+				if(cur < end && *cur == OS_TEXT(',')){
+					cur++;
+					continue;
+				}
+				if(cur < end && *cur == OS_TEXT('}')){
+					cur++;
+					return true;
+				}
+				return fail(cur < end ? OS_TEXT("expected ',' or '}'") : OS_TEXT("unterminated object"));
+			}
+		}
+
+		// pushes exactly one value on success
+		bool parseValue()
+		{
+			skipSpaces();
+			if(cur >= end){
+				return fail(OS_TEXT("unexpected end of text"));
+			}
+			switch(*cur){
+			case OS_TEXT('{'):
+			case OS_TEXT('['):
+				{
+					if(++depth > MAX_DEPTH){
+						return fail(OS_TEXT("nested too deep"));
+					}
+					bool ok = *cur == OS_TEXT('{') ? parseObject() : parseArray();
+					depth--;
+					return ok;
+				}
+
+			case OS_TEXT('\"'):
+				return parseString();
+
+			case OS_TEXT('t'):
+				if(!parseWord(OS_TEXT("true"), 4)) return false;
+				core->pushBool(true);
+				return true;
+
+			case OS_TEXT('f'):
+				if(!parseWord(OS_TEXT("false"), 5)) return false;
+				core->pushBool(false);
+				return true;
+
+			case OS_TEXT('n'):
+				if(!parseWord(OS_TEXT("null"), 4)) return false;
+				core->pushNull();
+				return true;
+			}
+			if(*cur == OS_TEXT('-') || (*cur >= OS_TEXT('0') && *cur <= OS_TEXT('9'))){
+				return parseNumber();
+			}
+			return fail(OS_TEXT("unexpected character"));
+		}
+	} parser = {this, str, str, str + len, NULL, 0, Buffer(allocator)};
+
+	int stack_count = stack_values.count;
+	if(parser.parseValue()){
+		parser.skipSpaces();
+		if(parser.cur >= parser.end){
+			return true;
+		}
+		parser.fail(OS_TEXT("unexpected text after the value"));
+	}
+	pop(stack_values.count - stack_count);
+
+	int line = 1;
+	const OS_CHAR * line_start = str;
+	for(const OS_CHAR * p = str; p < parser.cur; p++){
+		if(*p == OS_TEXT('\n')){
+			line++;
+			line_start = p + 1;
+		}
+	}
+	allocator->setException(String::format(allocator, OS_TEXT("invalid JSON: %s at line %d, column %d"),
+		parser.error, line, (int)(parser.cur - line_start) + 1));
+	return false;
+}
+
+// =====================================================================
+// =====================================================================
+// =====================================================================
+
+OS::Core::Strings::Strings(OS * allocator)
+	:
+	__construct(allocator, OS_TEXT("__construct")),
+	__destruct(allocator, OS_TEXT("__destruct")),
+	__instantiable(allocator, OS_TEXT("__instantiable")),
+	__newinstance(allocator, OS_TEXT("__newinstance")),
+	__callinstance(allocator, OS_TEXT("__callinstance")),
+	__object(allocator, OS_TEXT("__object")),
+	__get(allocator, OS_TEXT("__get")),
+	__set(allocator, OS_TEXT("__set")),
+	__isset(allocator, OS_TEXT("__isset")),
+	__getAt(allocator, OS_TEXT("__get@")),
+	__setAt(allocator, OS_TEXT("__set@")),
+	__issetAt(allocator, OS_TEXT("__isset@")),
+	__del(allocator, OS_TEXT("__del")),
+	__delAt(allocator, OS_TEXT("__del@")),
+	__getempty(allocator, OS_TEXT("__getempty")),
+	__setempty(allocator, OS_TEXT("__setempty")),
+	__delempty(allocator, OS_TEXT("__delempty")),
+	__getdim(allocator, OS_TEXT("__getdim")),
+	__setdim(allocator, OS_TEXT("__setdim")),
+	__deldim(allocator, OS_TEXT("__deldim")),
+	__iter(allocator, OS_TEXT("__iter")),
+	
+	__cmp(allocator, OS_TEXT("__cmp")),
+	__bitand(allocator, OS_TEXT("__bitand")),
+	__bitor(allocator, OS_TEXT("__bitor")),
+	__bitxor(allocator, OS_TEXT("__bitxor")),
+	__bitnot(allocator, OS_TEXT("__bitnot")),
+	__plus(allocator, OS_TEXT("__plus")),
+	__minus(allocator, OS_TEXT("__minus")),
+	__len(allocator, OS_TEXT("__len")),
+	__add(allocator, OS_TEXT("__add")),
+	__sub(allocator, OS_TEXT("__sub")),
+	__mul(allocator, OS_TEXT("__mul")),
+	__div(allocator, OS_TEXT("__div")),
+	__mod(allocator, OS_TEXT("__mod")),
+	__lshift(allocator, OS_TEXT("__lshift")),
+	__rshift(allocator, OS_TEXT("__rshift")),
+	__pow(allocator, OS_TEXT("__pow")),
+	
+	__rcmp(allocator, OS_TEXT("__rcmp")),
+	__rbitand(allocator, OS_TEXT("__rbitand")),
+	__rbitor(allocator, OS_TEXT("__rbitor")),
+	__rbitxor(allocator, OS_TEXT("__rbitxor")),
+	__radd(allocator, OS_TEXT("__radd")),
+	__rsub(allocator, OS_TEXT("__rsub")),
+	__rmul(allocator, OS_TEXT("__rmul")),
+	__rdiv(allocator, OS_TEXT("__rdiv")),
+	__rmod(allocator, OS_TEXT("__rmod")),
+	__rlshift(allocator, OS_TEXT("__rlshift")),
+	__rrshift(allocator, OS_TEXT("__rrshift")),
+	__rpow(allocator, OS_TEXT("__rpow")),
+	
+	func_unhandledException(allocator, OS_TEXT("unhandledException")),
+	func_getFilename(allocator, OS_TEXT("__getfilename")),
+	func_getDirname(allocator, OS_TEXT("__getdirname")),
+	func_extends(allocator, OS_TEXT("__extends")),
+	func_delete(allocator, OS_TEXT("__delete")),
+	func_length(allocator, OS_TEXT("__length")),
 	func_in(allocator, OS_TEXT("__in")),
 	func_is(allocator, OS_TEXT("__is")),
 	func_as(allocator, OS_TEXT("__as")),
@@ -14801,6 +15665,7 @@ OS::Core::Strings::Strings(OS * allocator)
 	func_echo(allocator, OS_TEXT("echo")),
 	func_require(allocator, OS_TEXT("require")),
 	func_call(allocator, OS_TEXT("call")),
+	func_debug(allocator, OS_TEXT("debug")),
 
 	func_core(allocator, OS_TEXT("{{CORE}}")),
 	func_main(allocator, OS_TEXT("{{main}}")),
@@ -14886,13 +15751,14 @@ OS::MemoryManager::~MemoryManager()
 
 OS::MemoryManager * OS::MemoryManager::retain()
 {
-	ref_count++;
+	// Interpreters on other threads may share the manager, see OSThreadHeapManager
+	OS_ATOMIC_ADD(&ref_count, 1);
 	return this;
 }
 
 void OS::MemoryManager::release()
 {
-	if(--ref_count <= 0){
+	if(OS_ATOMIC_ADD(&ref_count, -1) <= 0){
 		OS_ASSERT(ref_count == 0);
 		delete this;
 	}
@@ -15005,6 +15871,7 @@ OS::OS()
 	ref_count = 1;
 	memory_manager = NULL;
 	core = NULL;
+	total_allocated_bytes = 0;
 #ifdef OS_DEBUG
 	int mark = 0;
 	native_stack_start_mark = (int)&mark;
@@ -15043,6 +15910,7 @@ void OS::checkNativeStackUsage(const OS_CHAR * func_name)
 
 void * OS::malloc(int size OS_DBG_FILEPOS_DECL)
 {
+	total_allocated_bytes += size;
 	return memory_manager->malloc(size OS_DBG_FILEPOS_PARAM);
 }
 
@@ -15229,14 +16097,27 @@ OS::Core::Core(OS * p_allocator)
 	settings.create_text_eval_opcodes = false;
 	settings.primary_compiled_file = false;
 	settings.sourcecode_must_exist = false;
+	settings.compile_debug_calls = true;
 
 	// gcInitGreyList();
 	gc_start_when_used_bytes = 2*1024*1024;
 	gc_next_when_used_bytes = 2*1024*1024;
+	gc_pause = 200;
+	gc_total_time = 0;
+	gc_last_pause = 0;
+	gc_max_pause = 0;
 	gc_step_type = 0;
 	gc_in_progress = false;
 	gc_fix_in_progress = false;
 
+	OS_MEMSET(accessor_cache, 0, sizeof(accessor_cache));
+	accessor_epoch = 1;
+	table_version_seq = 0;
+	shapes = NULL;
+	shapes_head_mask = 0;
+	shapes_count = 0;
+	property_cache_epoch = 1;
+
 	OS_MEMSET(rand_state, 0, sizeof(rand_state));
 	rand_next = NULL;
 	rand_seed = 0;
@@ -15245,6 +16126,22 @@ OS::Core::Core(OS * p_allocator)
 	call_stack_overflow = false;
 	terminated = false;
 	terminated_code = 0;
+
+	sample_requested = false;
+	sample_callback = NULL;
+	sample_user_param = NULL;
+
+	opcode_counters = NULL;
+	native_call_callback = NULL;
+	native_call_user_param = NULL;
+	gc_cycles = 0;
+
+	running_coroutine = NULL;
+	coroutines = NULL;
+	yield_call_pos = -1;
+	execute_ret_stack_funcs = -1;
+	yield_requested = false;
+	yield_slot_pos = -1;
 }
 
 OS::Core::~Core()
@@ -15301,6 +16198,7 @@ bool OS::init(MemoryManager * p_manager)
 		initJsonModule();
 		initMathModule();
 		initGCModule();
+		initCoroutineModule();
 		initLangTokenizerModule();
 		initPostScript();
 #endif
@@ -15418,6 +16316,11 @@ void OS::Core::shutdown()
 		clearStackFunction(stack_func);
 	}
 	allocator->vectorClear(call_stack_funcs);
+	while(coroutines){
+		clearCoroutine(coroutines);
+	}
+	setValue(yield_value, Value());
+	deleteShapes();
 	// vectorClear(cache_values);
 
 	gc_step_type++;
@@ -15687,6 +16590,11 @@ OS::String OS::getCompiledFilename(const OS::String& resolved_filename)
 	return changeFilenameExt(resolved_filename, OS_EXT_COMPILED);
 }
 
+OS::String OS::getCompiledFilename(const OS::String& resolved_filename, OS_ESourceCodeType source_code_type)
+{
+	return getCompiledFilename(resolved_filename);
+}
+
 OS::String OS::getTextOpcodesFilename(const String& resolved_filename)
 {
 	if(!resolved_filename.isEmpty()){
@@ -16490,10 +17398,76 @@ bool OS::Core::hasSpecialPrefix(const Value& value)
 		const OS_CHAR * s = string->toChar();
 		return s[0] == OS_TEXT('_') && s[1] == OS_TEXT('_');
 	}
-	return false;
-#endif
+	return false;
+#endif
+}
+*/
+
+bool OS::Core::isAccessorName(const Value& index)
+{
+	if(OS_VALUE_TYPE(index) != OS_VALUE_TYPE_STRING){
+		return false;
+	}
+	GCStringValue * string = OS_VALUE_VARIANT(index).string;
+	int len = string->getLen();
+	if(len < 5){
+		return false;
+	}
+	// __set, __set@name or __get@name
+	const OS_CHAR * s = string->toChar();
+	if(s[0] != OS_TEXT('_') || s[1] != OS_TEXT('_') || s[3] != OS_TEXT('e') || s[4] != OS_TEXT('t')){
+		return false;
+	}
+	if(s[2] == OS_TEXT('s')){
+		return len == 5 || s[5] == OS_TEXT('@');
+	}
+	return s[2] == OS_TEXT('g') && len > 5 && s[5] == OS_TEXT('@');
+}
+
+bool OS::Core::isAccessorFree(GCValue * table_value, GCStringValue * name, int flag, bool prototype_enabled)
+{
+	if(table_value->table && table_value->table->has_accessors){
+		return false;
+	}
+	GCValue * proto = table_value->prototype;
+	if(!prototype_enabled || !proto){
+		return true;
+	}
+	AccessorCacheEntry& entry = accessor_cache[(proto->value_id * 31 + name->value_id) & (ACCESSOR_CACHE_SIZE-1)];
+	return entry.epoch == accessor_epoch
+		&& entry.proto_id == proto->value_id
+		&& entry.name_id == name->value_id
+		&& (entry.flags & flag);
+}
+
+void OS::Core::setAccessorFree(GCValue * table_value, GCStringValue * name, int flag)
+{
+	GCValue * proto = table_value->prototype;
+	if(!proto){
+		return;
+	}
+	AccessorCacheEntry& entry = accessor_cache[(proto->value_id * 31 + name->value_id) & (ACCESSOR_CACHE_SIZE-1)];
+	if(entry.epoch == accessor_epoch && entry.proto_id == proto->value_id && entry.name_id == name->value_id){
+		entry.flags |= flag;
+	}else{
+		entry.proto_id = proto->value_id;
+		entry.name_id = name->value_id;
+		entry.epoch = accessor_epoch;
+		entry.flags = flag;
+	}
+	// relinking any of these must drop the entry
+	for(; proto; proto = proto->prototype){
+		proto->is_accessor_cached = true;
+	}
+}
+
+void OS::Core::prototypeChanged(GCValue * changed_value)
+{
+	if(changed_value->is_accessor_cached){
+		accessor_epoch++;
+	}
+	property_cache_epoch++;
 }
-*/
 
 #define OS_SETTER_VALUE_PTR(_table_value, _index, _index_type, _value, _setter_enabled) \
 	do { \
@@ -16545,7 +17519,10 @@ bool OS::Core::hasSpecialPrefix(const Value& value)
 		Value local7_index_copy = local7_index; \
 		Value local7_value_copy = local7_value; \
 		const bool local7_setter_enabled = (_setter_enabled); \
-		if(local7_setter_enabled /*&& !hasSpecialPrefix(local7_index_copy)*/){ \
+		if(local7_setter_enabled && local7_index_type == OS_VALUE_TYPE_STRING \
+			&& isAccessorFree(local7_table_value, OS_VALUE_VARIANT(local7_index_copy).string, ACCESSOR_NO_SETTER, true)){ \
+			/* plain store, known to have no accessor */ \
+		}else if(local7_setter_enabled /*&& !hasSpecialPrefix(local7_index_copy)*/){ \
 			Value func; \
 			if(local7_index_type == OS_VALUE_TYPE_STRING){ \
 				const void * buf1 = strings->__setAt.toChar(); \
@@ -16583,6 +17560,8 @@ bool OS::Core::hasSpecialPrefix(const Value& value)
 					break; \
 				} \
 				allocator->setException(String::format(allocator, OS_TEXT("recursive set %s"), valueToString(local7_index_copy).toChar())); \
+			}else if(local7_index_type == OS_VALUE_TYPE_STRING){ \
+				setAccessorFree(local7_table_value, OS_VALUE_VARIANT(local7_index_copy).string, ACCESSOR_NO_SETTER); \
 			} \
 		} \
 		OS_ASSERT(local7_table_value->type != OS_VALUE_TYPE_STRING); \
@@ -16699,6 +17678,7 @@ void OS::Core::setPrototypeValue(const Value& val, const Value& proto)
 	case OS_VALUE_TYPE_CFUNCTION:
 		// OS_ASSERT(OS_VALUE_VARIANT(val).value->prototype && OS_VALUE_VARIANT(val).value->prototype->ref_count > 0);
 		// OS_VALUE_VARIANT(val).value->prototype->ref_count--;
+		prototypeChanged(OS_VALUE_VARIANT(val).value);
 		setValue(OS_VALUE_VARIANT(val).value->prototype, proto.getGCValue());
 		// OS_VALUE_VARIANT(val).value->prototype->ref_count++;
 		return;
@@ -16722,6 +17702,7 @@ void OS::Core::setPrototypeValue(const Value& val, const Value& proto, int userd
 	case OS_VALUE_TYPE_CFUNCTION:
 		// OS_ASSERT(OS_VALUE_VARIANT(val).value->prototype && OS_VALUE_VARIANT(val).value->prototype->ref_count > 0);
 		// OS_VALUE_VARIANT(val).value->prototype->ref_count--;
+		prototypeChanged(OS_VALUE_VARIANT(val).value);
 		setValue(OS_VALUE_VARIANT(val).value->prototype, proto.getGCValue());
 		// OS_VALUE_VARIANT(val).value->prototype->ref_count++;
 		return;
@@ -18088,6 +19069,147 @@ void OS::pushBackTrace(int skip_funcs, int max_trace_funcs)
 	core->pushBackTrace(skip_funcs, max_trace_funcs);
 }
 
+int OS::getCallStackFrames(CallStackFrame * frames, int max_frames)
+{
+	String core_str(this, OS_TEXT("{{CORE}}"));
+	int count = 0;
+	for(int i = core->call_stack_funcs.count-1; i >= 0 && count < max_frames; i--){
+		Core::StackFunction * stack_func = core->call_stack_funcs.buf + i;
+		Core::Program * prog = stack_func->func->prog;
+		if((!stack_func->func->name || core_str == stack_func->func->name) && !prog->filename.getDataSize()){
+			continue;
+		}
+		CallStackFrame * frame = frames + count++;
+		frame->name = stack_func->func->name ? stack_func->func->name->toChar() : OS_TEXT("{{lambda}}");
+		frame->file = prog->filename.getDataSize() ? prog->filename.toChar() : OS_TEXT("{{CORE}}");
+		frame->line = 0;
+		if(prog->filename.getDataSize() && prog->debug_info.count > 0){
+			Core::Program::DebugInfoItem * debug_info = prog->getDebugInfo((int)(stack_func->opcodes - prog->opcodes.buf));
+			if(debug_info){
+				frame->line = (int)debug_info->line;
+			}
+		}
+	}
+	return count;
+}
+
+void OS::setSampleCallback(OS_SampleCallback callback, void * user_param)
+{
+	core->sample_callback = callback;
+	core->sample_user_param = user_param;
+}
+
+void OS::requestSample()
+{
+	core->sample_requested = true;
+}
+
+void OS::setOpcodeCounters(OS_INT64 * counters)
+{
+	core->opcode_counters = counters;
+}
+
+int OS::getOpcodeCount()
+{
+	return Core::OPCODE_COUNT;
+}
+
+const OS_CHAR * OS::getOpcodeName(int opcode)
+{
+	switch(opcode){
+#define OS_OPCODE_NAME(opcode) case Core::opcode: return OS_TEXT(#opcode) + 3
+		OS_OPCODE_NAME(OP_NEW_FUNCTION);
+		OS_OPCODE_NAME(OP_NEW_ARRAY);
+		OS_OPCODE_NAME(OP_NEW_OBJECT);
+		OS_OPCODE_NAME(OP_RETURN);
+		OS_OPCODE_NAME(OP_JUMP);
+		OS_OPCODE_NAME(OP_MULTI);
+		OS_OPCODE_NAME(OP_MOVE);
+		OS_OPCODE_NAME(OP_MOVE2);
+		OS_OPCODE_NAME(OP_GET_XCONST);
+		OS_OPCODE_NAME(OP_SUPER_CALL);
+		OS_OPCODE_NAME(OP_CALL);
+		OS_OPCODE_NAME(OP_CALL_METHOD);
+#ifdef OS_TAIL_CALL_ENABLED
+		OS_OPCODE_NAME(OP_TAIL_CALL);
+		OS_OPCODE_NAME(OP_TAIL_CALL_METHOD);
+#endif
+		OS_OPCODE_NAME(OP_INIT_ITER);
+		OS_OPCODE_NAME(OP_GET_PROPERTY);
+		OS_OPCODE_NAME(OP_SET_PROPERTY);
+		OS_OPCODE_NAME(OP_INIT_PROPERTY);
+		OS_OPCODE_NAME(OP_GET_UPVALUE);
+		OS_OPCODE_NAME(OP_SET_UPVALUE);
+		OS_OPCODE_NAME(OP_LOGIC_PTR_EQ);
+		OS_OPCODE_NAME(OP_LOGIC_EQ);
+		OS_OPCODE_NAME(OP_LOGIC_GREATER);
+		OS_OPCODE_NAME(OP_LOGIC_GE);
+		OS_OPCODE_NAME(OP_LOGIC_BOOL);
+		OS_OPCODE_NAME(OP_BIT_AND);
+		OS_OPCODE_NAME(OP_BIT_OR);
+		OS_OPCODE_NAME(OP_BIT_XOR);
+		OS_OPCODE_NAME(OP_COMPARE);
+		OS_OPCODE_NAME(OP_ADD);
+		OS_OPCODE_NAME(OP_SUB);
+		OS_OPCODE_NAME(OP_MUL);
+		OS_OPCODE_NAME(OP_DIV);
+		OS_OPCODE_NAME(OP_MOD);
+		OS_OPCODE_NAME(OP_LSHIFT);
+		OS_OPCODE_NAME(OP_RSHIFT);
+		OS_OPCODE_NAME(OP_POW);
+		OS_OPCODE_NAME(OP_BIT_NOT);
+		OS_OPCODE_NAME(OP_PLUS);
+		OS_OPCODE_NAME(OP_MINUS);
+		OS_OPCODE_NAME(OP_NUMBER_LOGIC_EQ);
+		OS_OPCODE_NAME(OP_NUMBER_LOGIC_GREATER);
+		OS_OPCODE_NAME(OP_NUMBER_LOGIC_GE);
+		OS_OPCODE_NAME(OP_NUMBER_BIT_AND);
+		OS_OPCODE_NAME(OP_NUMBER_BIT_OR);
+		OS_OPCODE_NAME(OP_NUMBER_BIT_XOR);
+		OS_OPCODE_NAME(OP_NUMBER_ADD);
+		OS_OPCODE_NAME(OP_NUMBER_SUB);
+		OS_OPCODE_NAME(OP_NUMBER_MUL);
+		OS_OPCODE_NAME(OP_NUMBER_DIV);
+		OS_OPCODE_NAME(OP_NUMBER_MOD);
+		OS_OPCODE_NAME(OP_NUMBER_LSHIFT);
+		OS_OPCODE_NAME(OP_NUMBER_RSHIFT);
+		OS_OPCODE_NAME(OP_NUMBER_POW);
+		OS_OPCODE_NAME(OP_NUMBER_ADD_LC);
+		OS_OPCODE_NAME(OP_NUMBER_SUB_LC);
+		OS_OPCODE_NAME(OP_NUMBER_ADD_LL);
+		OS_OPCODE_NAME(OP_NUMBER_SUB_LL);
+#undef OS_OPCODE_NAME
+	}
+	return OS_TEXT("");
+}
+
+void OS::setNativeCallCallback(OS_NativeCallCallback callback, void * user_param)
+{
+	core->native_call_callback = callback;
+	core->native_call_user_param = user_param;
+}
+
+bool OS::getCFunction(int offs, OS_CFunction * func, void ** func_user_param)
+{
+	Core::Value value = core->getStackValue(offs);
+	if(OS_VALUE_TYPE(value) != OS_VALUE_TYPE_CFUNCTION){
+		return false;
+	}
+	*func = OS_VALUE_VARIANT(value).cfunc->func;
+	*func_user_param = OS_VALUE_VARIANT(value).cfunc->user_param;
+	return true;
+}
+
+int OS::getGCCycles()
+{
+	return core->gc_cycles;
+}
+
+OS_INT64 OS::getTotalAllocatedBytes()
+{
+	return total_allocated_bytes;
+}
+
 void OS::pushStackValue(int offs)
 {
 	core->pushStackValue(offs);
@@ -19412,7 +20534,8 @@ bool OS::Core::hasProperty(GCValue * table_value, Value index, bool getter_enabl
 		const bool local3_getter_enabled = (_getter_enabled); \
 		if(local3_getter_enabled /*&& !hasSpecialPrefix(local3_index)*/){ \
 			Value local3_this = (_this); \
-			if(local3_index_type == OS_VALUE_TYPE_STRING){ \
+			if(local3_index_type == OS_VALUE_TYPE_STRING \
+				&& !isAccessorFree(local3_table_value, OS_VALUE_VARIANT(local3_index).string, ACCESSOR_NO_GETTER, local3_prototype_enabled)){ \
 				const void * buf1 = strings->__getAt.toChar(); \
 				int size1 = strings->__getAt.getDataSize(); \
 				const void * buf2 = OS_VALUE_VARIANT(local3_index).string->toChar(); \
@@ -19427,6 +20550,9 @@ bool OS::Core::hasProperty(GCValue * table_value, Value index, bool getter_enabl
 					local3_result = stack_values.buf[--stack_values.count]; \
 					break; \
 				} \
+				if(local3_prototype_enabled){ \
+					setAccessorFree(local3_table_value, OS_VALUE_VARIANT(local3_index).string, ACCESSOR_NO_GETTER); \
+				} \
 			} \
 			OS_GET_PROP_VALUE_PTR(local3_result_bool, local3_result, local3_table_value, strings->__get, OS_VALUE_TYPE_STRING, local3_prototype_enabled); \
 			if(local3_result_bool){ \
@@ -19445,6 +20571,107 @@ bool OS::Core::hasProperty(GCValue * table_value, Value index, bool getter_enabl
 		OS_SET_VALUE_NULL(local3_result); \
 	}while(false)
 
+bool OS::Core::getCachedPropertyValue(Value& result, const Value& obj, const Value& index, Program * prog, int opcode_pos)
+{
+	OS_ASSERT(OS_VALUE_TYPE(index) == OS_VALUE_TYPE_STRING);
+	switch(OS_VALUE_TYPE(obj)){
+	case OS_VALUE_TYPE_ARRAY:
+	case OS_VALUE_TYPE_OBJECT:
+	case OS_VALUE_TYPE_USERDATA:
+	case OS_VALUE_TYPE_USERPTR:
+	case OS_VALUE_TYPE_FUNCTION:
+	case OS_VALUE_TYPE_CFUNCTION:
+		break;
+
+	default:
+		return false;
+	}
+	if(!prog->property_cache_slots){
+		int size = sizeof(int) * prog->opcodes.count;
+		prog->property_cache_slots = (int*)malloc(size OS_DBG_FILEPOS);
+		OS_MEMSET(prog->property_cache_slots, 0, size);
+	}
+	int slot = prog->property_cache_slots[opcode_pos];
+	if(!slot){
+		PropertyCache cache;
+		OS_MEMSET(&cache, 0, sizeof(cache));
+		allocator->vectorAddItem(prog->property_caches, cache OS_DBG_FILEPOS);
+		slot = prog->property_cache_slots[opcode_pos] = prog->property_caches.count;
+	}
+	PropertyCache * cache = &prog->property_caches[slot-1];
+	if(cache->misses > PROPERTY_CACHE_MAX_MISSES){
+		// megamorphic, try again after a while as the opcode may have settled
+		if(++cache->misses < PROPERTY_CACHE_MAX_MISSES + PROPERTY_CACHE_RETRY_AFTER){
+			return false;
+		}
+		cache->misses = PROPERTY_CACHE_MAX_MISSES / 2;
+	}
+	GCValue * value = OS_VALUE_VARIANT(obj).value;
+	int table_version = value->table ? value->table->version : 0;
+	Shape * shape = value->table ? value->table->shape : NULL;
+	PropertyCacheEntry * entries = cache->entries;
+	bool stale = false;
+	for(int i = 0; i < PROPERTY_CACHE_WAYS; i++){
+		PropertyCacheEntry * entry = entries + i;
+		if(shape && entry->shape == shape){
+			result = value->table->block[entry->slot]->value;
+			if(cache->misses > 0) cache->misses--;
+			return true;
+		}
+		if(entry->value_id == value->value_id && entry->table_version == table_version){
+			if(!entry->epoch || entry->epoch == property_cache_epoch){
+				result = entry->prop->value;
+				if(cache->misses > 0) cache->misses--;
+				return true;
+			}
+			stale = true;
+		}
+	}
+	// only a receiver the opcode has not seen counts, a prototype changed
+	// since (a new epoch) says nothing about how many receivers there are
+	if(!stale){
+		cache->misses++;
+	}
+
+	// miss, find the property without getters and remember where it is
+	Property * prop = NULL;
+	int epoch = 0;
+	if(value->table){
+		prop = value->table->get(index, OS_VALUE_TYPE_STRING);
+	}
+	if(!prop){
+		GCValue * cur = value->prototype;
+		for(; cur; cur = cur->prototype){
+			if(!cur->table){
+				// a table created later could not be watched
+				return false;
+			}
+			if((prop = cur->table->get(index, OS_VALUE_TYPE_STRING))){
+				break;
+			}
+		}
+		if(!prop){
+			return false;
+		}
+		for(GCValue * watched = value->prototype;; watched = watched->prototype){
+			watched->table->in_property_cache = true;
+			if(watched == cur) break;
+		}
+		epoch = property_cache_epoch;
+	}
+	for(int i = PROPERTY_CACHE_WAYS-1; i > 0; i--){
+		entries[i] = entries[i-1];
+	}
+	entries->value_id = value->value_id;
+	entries->table_version = table_version;
+	entries->prop = prop;
+	entries->epoch = epoch;
+	entries->shape = epoch ? NULL : shape;
+	entries->slot = entries->shape ? entries->shape->find(index, OS_VALUE_TYPE_STRING) : 0;
+	result = prop->value;
+	return true;
+}
+
 void OS::Core::pushPropertyValue(GCValue * table_value, const Value& _index, bool getter_enabled, bool prototype_enabled)
 {
 	Value value;
@@ -19646,16 +20873,254 @@ void OS::Core::reloadStackFunctionCache()
 	}
 }
 
+void OS::Core::linkCoroutine(Coroutine * co)
+{
+	co->prev = NULL;
+	co->next = coroutines;
+	if(coroutines){
+		coroutines->prev = co;
+	}
+	coroutines = co;
+}
+
+void OS::Core::unlinkCoroutine(Coroutine * co)
+{
+	if(co->prev){
+		co->prev->next = co->next;
+	}else{
+		OS_ASSERT(coroutines == co);
+		coroutines = co->next;
+	}
+	if(co->next){
+		co->next->prev = co->prev;
+	}
+	co->prev = co->next = NULL;
+}
+
+void OS::Core::suspendCoroutine()
+{
+	// move the frames of the running coroutine and their stack values aside,
+	// its base frame then leaves like a return of the yielded value
+	Coroutine * co = running_coroutine;
+	OS_ASSERT(co && co->status == Coroutine::RUNNING && call_stack_funcs.count > co->ret_stack_funcs);
+	int first = co->ret_stack_funcs;
+	int base = call_stack_funcs[first].locals_stack_pos;
+	int caller_stack_size = call_stack_funcs[first].caller_stack_size;
+
+	int count = stack_values.count - base;
+	allocator->vectorReserveCapacity(co->values, count OS_DBG_FILEPOS);
+	OS_MEMCPY(co->values.buf, stack_values.buf + base, sizeof(Value) * count);
+	co->values.count = count;
+	retainValues(co->values.buf, count);
+	co->base = base;
+	co->yield_slot = yield_slot_pos >= base ? yield_slot_pos - base : -1;
+
+	int num_frames = call_stack_funcs.count - first;
+	allocator->vectorReserveCapacity(co->frames, num_frames OS_DBG_FILEPOS);
+	OS_MEMCPY((void*)co->frames.buf, call_stack_funcs.buf + first, sizeof(StackFunction) * num_frames);
+	co->frames.count = num_frames;
+	for(int i = 0; i < num_frames; i++){
+		StackFunction * frame = &co->frames[i];
+		frame->locals->values = co->values.buf + (frame->locals_stack_pos - base);
+		// callFT expects the free slots to have no sub functions
+		OS_MEMSET((void*)&call_stack_funcs[first + i].sub_funcs, 0, sizeof(frame->sub_funcs));
+	}
+	call_stack_funcs.count = first;
+
+	if(caller_stack_size > stack_values.count){
+		OS_ASSERT(caller_stack_size <= stack_values.capacity);
+		OS_SET_NULL_VALUES(stack_values.buf + stack_values.count, caller_stack_size - stack_values.count);
+	}
+	stack_values.count = caller_stack_size;
+	stack_values.buf[base] = yield_value;
+	setValue(yield_value, Value());
+
+	co->status = Coroutine::SUSPENDED;
+	linkCoroutine(co);
+	reloadStackFunctionCache();
+}
+
+void OS::Core::restoreCoroutine(Coroutine * co, const Value& resume_value)
+{
+	// put the frames back on top of the current ones, the stack slice moves
+	// to the top of the stack as well
+	OS_ASSERT(co->status == Coroutine::SUSPENDED);
+	Value value = resume_value;
+	int start = stack_values.count;
+	int count = co->values.count;
+	reserveStackValues(start + count);
+	OS_MEMCPY(stack_values.buf + start, co->values.buf, sizeof(Value) * count);
+	stack_values.count = start + count;
+	releaseValues(stack_values.buf + start, count);
+	if(co->yield_slot >= 0){
+		stack_values.buf[start + co->yield_slot] = value;
+	}
+
+	int delta = start - co->base;
+	int num_frames = co->frames.count;
+	co->ret_stack_funcs = call_stack_funcs.count;
+	if(call_stack_funcs.capacity < call_stack_funcs.count + num_frames){
+		// frames are moved as they are, see callFT
+		call_stack_funcs.capacity = call_stack_funcs.count + num_frames + 8;
+		StackFunction * new_buf = (StackFunction*)malloc(sizeof(StackFunction)*call_stack_funcs.capacity OS_DBG_FILEPOS);
+		OS_MEMCPY((void*)new_buf, call_stack_funcs.buf, sizeof(StackFunction) * call_stack_funcs.count);
+		free(call_stack_funcs.buf);
+		call_stack_funcs.buf = new_buf;
+	}
+	for(int i = 0; i < num_frames; i++){
+		StackFunction * frame = call_stack_funcs.buf + call_stack_funcs.count++;
+		OS_MEMCPY((void*)frame, &co->frames[i], sizeof(StackFunction));
+		frame->locals_stack_pos += delta;
+		frame->caller_stack_size += delta;
+		frame->locals->values = stack_values.buf + frame->locals_stack_pos;
+	}
+	co->frames.count = 0;
+	allocator->vectorClear(co->frames);
+	allocator->vectorClear(co->values);
+
+	unlinkCoroutine(co);
+	co->status = Coroutine::RUNNING;
+	reloadStackFunctionCache();
+}
+
+void OS::Core::clearCoroutine(Coroutine * co)
+{
+	if(co->status == Coroutine::NEW || co->status == Coroutine::SUSPENDED){
+		unlinkCoroutine(co);
+	}
+	for(int i = co->frames.count-1; i >= 0; i--){
+		clearStackFunction(&co->frames[i]);
+	}
+	co->frames.count = 0;
+	allocator->vectorClear(co->frames);
+	releaseValues(co->values.buf, co->values.count);
+	allocator->vectorClear(co->values);
+	co->status = Coroutine::DEAD;
+}
+
+#ifdef OS_THREADED_DISPATCH
+// fetch the next opcode and jump right to its handler
+#define OS_DISPATCH_OPCODE() \
+	OS_PROFILE_END_OPCODE(opcode); \
+	instruction = *(stack_func = this->stack_func)->opcodes++; \
+	opcode = OS_GET_OPCODE_WITH_CC(instruction); \
+	OS_PROFILE_BEGIN_OPCODE(opcode); \
+	stack_func_prog_values = this->stack_func_prog_values; \
+	stack_func_locals = this->stack_func_locals; \
+	goto *opcode_table[opcode]
+// an opcode which could throw goes back to the loop if it did
+#define OS_NEXT_OPCODE() if(terminated) break; OS_DISPATCH_OPCODE()
+#define OS_NEXT_OPCODE_NOTHROW() OS_DISPATCH_OPCODE()
+#else
+#define OS_NEXT_OPCODE() break
+#define OS_NEXT_OPCODE_NOTHROW() break
+#endif
+
 void OS::Core::execute()
+{
+	execute(call_stack_funcs.count-1);
+}
+
+// runs the frames above ret_stack_funcs until they return, throw or yield
+#if defined OS_THREADED_DISPATCH && !defined __clang__
+// GCC's global CSE and cross jumping merge the handlers' jumps back into one
+__attribute__((optimize("no-gcse", "no-crossjumping")))
+#endif
+void OS::Core::execute(int ret_stack_funcs)
 {
 #ifdef OS_DEBUG
 	allocator->checkNativeStackUsage(OS_TEXT("OS::Core::execute"));
 #endif
 	StackFunction * stack_func;
-	int a, b, c, res, ret_stack_funcs = call_stack_funcs.count-1;
+	int a, b, c, res;
 	Program * prog;
 	Value * left_value, * right_value, * index_value, value;
 	Locals * scope;
+	// restores the caller's level on every return, isYieldable compares it with the coroutine's base
+	struct ExecuteLevel
+	{
+		int * level;
+		int saved;
+
+		ExecuteLevel(int * p_level, int value){ level = p_level; saved = *level; *level = value; }
+		~ExecuteLevel(){ *level = saved; }
+	} execute_level(&execute_ret_stack_funcs, ret_stack_funcs);
+#ifdef OS_THREADED_DISPATCH
+	static const void * dispatch_table[1<<OS_SIZE_OP];
+	static const void * counting_table[1<<OS_SIZE_OP];
+	static int tables_state; // 0 - empty, 1 - being filled, 2 - ready
+	if(__atomic_load_n(&tables_state, __ATOMIC_ACQUIRE) != 2){
+		// interpreters on other threads may enter execute() for the first time as well
+		if(__sync_bool_compare_and_swap(&tables_state, 0, 1)){
+			for(int i = 0; i < (1<<OS_SIZE_OP); i++){
+				dispatch_table[i] = &&corrupted;
+				// while counting, every opcode passes count_opcode on the way to its handler
+				counting_table[i] = &&count_opcode;
+			}
+			dispatch_table[OP_LOGIC_BOOL] = &&opcode_label_OP_LOGIC_BOOL;
+			dispatch_table[OP_LOGIC_PTR_EQ] = &&opcode_label_OP_LOGIC_PTR_EQ;
+			dispatch_table[OP_LOGIC_EQ] = &&opcode_label_OP_LOGIC_EQ;
+			dispatch_table[OP_NUMBER_LOGIC_EQ] = &&opcode_label_OP_NUMBER_LOGIC_EQ;
+			dispatch_table[OP_LOGIC_GREATER] = &&opcode_label_OP_LOGIC_GREATER;
+			dispatch_table[OP_NUMBER_LOGIC_GREATER] = &&opcode_label_OP_NUMBER_LOGIC_GREATER;
+			dispatch_table[OP_LOGIC_GE] = &&opcode_label_OP_LOGIC_GE;
+			dispatch_table[OP_NUMBER_LOGIC_GE] = &&opcode_label_OP_NUMBER_LOGIC_GE;
+			dispatch_table[OP_JUMP] = &&opcode_label_OP_JUMP;
+			dispatch_table[OP_BIT_NOT] = &&opcode_label_OP_BIT_NOT;
+			dispatch_table[OP_PLUS] = &&opcode_label_OP_PLUS;
+			dispatch_table[OP_MINUS] = &&opcode_label_OP_MINUS;
+			dispatch_table[OP_BIT_AND] = &&opcode_label_OP_BIT_AND;
+			dispatch_table[OP_NUMBER_BIT_AND] = &&opcode_label_OP_NUMBER_BIT_AND;
+			dispatch_table[OP_BIT_OR] = &&opcode_label_OP_BIT_OR;
+			dispatch_table[OP_NUMBER_BIT_OR] = &&opcode_label_OP_NUMBER_BIT_OR;
+			dispatch_table[OP_BIT_XOR] = &&opcode_label_OP_BIT_XOR;
+			dispatch_table[OP_NUMBER_BIT_XOR] = &&opcode_label_OP_NUMBER_BIT_XOR;
+			dispatch_table[OP_ADD] = &&opcode_label_OP_ADD;
+			dispatch_table[OP_NUMBER_ADD] = &&opcode_label_OP_NUMBER_ADD;
+			dispatch_table[OP_NUMBER_ADD_LC] = &&opcode_label_OP_NUMBER_ADD_LC;
+			dispatch_table[OP_NUMBER_ADD_LL] = &&opcode_label_OP_NUMBER_ADD_LL;
+			dispatch_table[OP_COMPARE] = &&opcode_label_OP_COMPARE;
+			dispatch_table[OP_SUB] = &&opcode_label_OP_SUB;
+			dispatch_table[OP_NUMBER_SUB] = &&opcode_label_OP_NUMBER_SUB;
+			dispatch_table[OP_NUMBER_SUB_LC] = &&opcode_label_OP_NUMBER_SUB_LC;
+			dispatch_table[OP_NUMBER_SUB_LL] = &&opcode_label_OP_NUMBER_SUB_LL;
+			dispatch_table[OP_MUL] = &&opcode_label_OP_MUL;
+			dispatch_table[OP_NUMBER_MUL] = &&opcode_label_OP_NUMBER_MUL;
+			dispatch_table[OP_DIV] = &&opcode_label_OP_DIV;
+			dispatch_table[OP_NUMBER_DIV] = &&opcode_label_OP_NUMBER_DIV;
+			dispatch_table[OP_MOD] = &&opcode_label_OP_MOD;
+			dispatch_table[OP_NUMBER_MOD] = &&opcode_label_OP_NUMBER_MOD;
+			dispatch_table[OP_LSHIFT] = &&opcode_label_OP_LSHIFT;
+			dispatch_table[OP_NUMBER_LSHIFT] = &&opcode_label_OP_NUMBER_LSHIFT;
+			dispatch_table[OP_RSHIFT] = &&opcode_label_OP_RSHIFT;
+			dispatch_table[OP_NUMBER_RSHIFT] = &&opcode_label_OP_NUMBER_RSHIFT;
+			dispatch_table[OP_POW] = &&opcode_label_OP_POW;
+			dispatch_table[OP_NUMBER_POW] = &&opcode_label_OP_NUMBER_POW;
+			dispatch_table[OP_NEW_FUNCTION] = &&opcode_label_OP_NEW_FUNCTION;
+			dispatch_table[OP_CALL] = &&opcode_label_OP_CALL;
+			dispatch_table[OP_INIT_ITER] = &&opcode_label_OP_INIT_ITER;
+			dispatch_table[OP_CALL_METHOD] = &&opcode_label_OP_CALL_METHOD;
+			dispatch_table[OP_SUPER_CALL] = &&opcode_label_OP_SUPER_CALL;
+			dispatch_table[OP_MOVE] = &&opcode_label_OP_MOVE;
+			dispatch_table[OP_MOVE2] = &&opcode_label_OP_MOVE2;
+			dispatch_table[OP_GET_XCONST] = &&opcode_label_OP_GET_XCONST;
+			dispatch_table[OP_GET_UPVALUE] = &&opcode_label_OP_GET_UPVALUE;
+			dispatch_table[OP_SET_UPVALUE] = &&opcode_label_OP_SET_UPVALUE;
+			dispatch_table[OP_GET_PROPERTY] = &&opcode_label_OP_GET_PROPERTY;
+			dispatch_table[OP_INIT_PROPERTY] = &&opcode_label_OP_INIT_PROPERTY;
+			dispatch_table[OP_SET_PROPERTY] = &&opcode_label_OP_SET_PROPERTY;
+			dispatch_table[OP_NEW_OBJECT] = &&opcode_label_OP_NEW_OBJECT;
+			dispatch_table[OP_NEW_ARRAY] = &&opcode_label_OP_NEW_ARRAY;
+			dispatch_table[OP_MULTI] = &&opcode_label_OP_MULTI;
+			dispatch_table[OP_RETURN] = &&opcode_label_OP_RETURN;
+			__atomic_store_n(&tables_state, 2, __ATOMIC_RELEASE);
+		}else{
+			while(__atomic_load_n(&tables_state, __ATOMIC_ACQUIRE) != 2){}
+		}
+	}
+	// chosen per call, so every interpreter counts its opcodes or not on its own
+	const void * const * opcode_table = opcode_counters ? counting_table : dispatch_table;
+#endif
 #ifdef OS_INFINITE_LOOP_OPCODES
 	for(int opcodes_executed = 0;; opcodes_executed++){
 #else
@@ -19738,6 +21203,23 @@ void OS::Core::execute()
 				}
 			}
 		}
+		if(yield_requested){
+			// coroutine.yield was the last call, the frames above ret_stack_funcs are the coroutine's
+			yield_requested = false;
+			if(running_coroutine && running_coroutine->ret_stack_funcs == ret_stack_funcs){
+				suspendCoroutine();
+				return;
+			}
+			setValue(yield_value, Value());
+			allocator->setException(OS_TEXT("coroutine.yield can't be used across a native call"));
+			continue;
+		}
+		if(sample_requested){
+			sample_requested = false;
+			if(sample_callback){
+				sample_callback(allocator, sample_user_param);
+			}
+		}
 		OS_ASSERT(this->stack_func->opcodes >= this->stack_func->func->prog->opcodes.buf + this->stack_func->func->func_decl->opcodes_pos);
 		OS_ASSERT(this->stack_func->opcodes < this->stack_func->func->prog->opcodes.buf + this->stack_func->func->func_decl->opcodes_pos + this->stack_func->func->func_decl->opcodes_size);
 		Instruction instruction = *(stack_func = this->stack_func)->opcodes++;
@@ -19758,6 +21240,18 @@ void OS::Core::execute()
 #if 1
 		Value * stack_func_prog_values = this->stack_func_prog_values;
 		Value * stack_func_locals = this->stack_func_locals;
+#endif
+#ifdef OS_THREADED_DISPATCH
+		goto *opcode_table[opcode];
+count_opcode:
+		if(opcode_counters){
+			opcode_counters[opcode]++;
+		}
+		goto *dispatch_table[opcode];
+#else
+		if(opcode_counters){
+			opcode_counters[opcode]++;
+		}
 #endif
 		switch(opcode){
 		// case 0: case 1: case 2: case 3:
@@ -19789,7 +21283,7 @@ corrupted:
 					b = OS_GETARG_sBx(instruction);
 					stack_func->opcodes += b + 1;
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_LOGIC_PTR_EQ):
@@ -19826,7 +21320,7 @@ corrupted:
 					b = OS_GETARG_sBx(instruction);
 					stack_func->opcodes += b + 1;
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_LOGIC_EQ):
@@ -19865,7 +21359,7 @@ corrupted:
 					b = OS_GETARG_sBx(instruction);
 					stack_func->opcodes += b + 1;
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_LOGIC_EQ):
@@ -19897,7 +21391,7 @@ corrupted:
 					b = OS_GETARG_sBx(instruction);
 					stack_func->opcodes += b + 1;
 				}
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_LOGIC_GREATER):
@@ -19936,7 +21430,7 @@ corrupted:
 					b = OS_GETARG_sBx(instruction);
 					stack_func->opcodes += b + 1;
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_LOGIC_GREATER):
@@ -19968,7 +21462,7 @@ corrupted:
 					b = OS_GETARG_sBx(instruction);
 					stack_func->opcodes += b + 1;
 				}
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_LOGIC_GE):
@@ -20007,7 +21501,7 @@ corrupted:
 					b = OS_GETARG_sBx(instruction);
 					stack_func->opcodes += b + 1;
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_LOGIC_GE):
@@ -20039,7 +21533,7 @@ corrupted:
 					b = OS_GETARG_sBx(instruction);
 					stack_func->opcodes += b + 1;
 				}
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE(OP_JUMP):
@@ -20048,7 +21542,13 @@ corrupted:
 				OS_ASSERT(this->stack_func->opcodes+a >= this->stack_func->func->prog->opcodes.buf + this->stack_func->func->func_decl->opcodes_pos);
 				OS_ASSERT(this->stack_func->opcodes+a < this->stack_func->func->prog->opcodes.buf + this->stack_func->func->func_decl->opcodes_pos + this->stack_func->func->func_decl->opcodes_size);
 				stack_func->opcodes += a;
-				break;
+#ifdef OS_THREADED_DISPATCH
+				// handlers jump straight to each other, a loop without calls gets back to the loop head here
+				if(sample_requested){
+					break;
+				}
+#endif
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_BIT_NOT):
@@ -20063,7 +21563,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_PLUS):
@@ -20078,7 +21578,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_MINUS):
@@ -20093,7 +21593,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_BIT_AND):
@@ -20110,7 +21610,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_BIT_AND):
@@ -20123,7 +21623,7 @@ corrupted:
 				right_value = & OS_GETARG_C_VALUE();
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				stack_func_locals[OS_GETARG_A(instruction)] = (OS_INT)OS_VALUE_NUMBER(*left_value) & (OS_INT)OS_VALUE_NUMBER(*right_value);
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_BIT_OR):
@@ -20140,7 +21640,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_BIT_OR):
@@ -20153,7 +21653,7 @@ corrupted:
 				right_value = & OS_GETARG_C_VALUE();
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				stack_func_locals[OS_GETARG_A(instruction)] = (OS_INT)OS_VALUE_NUMBER(*left_value) | (OS_INT)OS_VALUE_NUMBER(*right_value);
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_BIT_XOR):
@@ -20170,7 +21670,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_BIT_XOR):
@@ -20183,7 +21683,7 @@ corrupted:
 				right_value = & OS_GETARG_C_VALUE();
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				stack_func_locals[OS_GETARG_A(instruction)] = (OS_INT)OS_VALUE_NUMBER(*left_value) ^ (OS_INT)OS_VALUE_NUMBER(*right_value);
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_ADD): // +
@@ -20200,7 +21700,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_ADD): // +
@@ -20213,7 +21713,7 @@ corrupted:
 				right_value = & OS_GETARG_C_VALUE();
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				OS_SET_VALUE_NUMBER(stack_func_locals[OS_GETARG_A(instruction)], OS_VALUE_NUMBER(*left_value) + OS_VALUE_NUMBER(*right_value));
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_ADD_LC): // +
@@ -20226,7 +21726,7 @@ corrupted:
 				right_value = & stack_func_prog_values[OS_GETARG_C(instruction)];
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				OS_SET_VALUE_NUMBER(stack_func_locals[OS_GETARG_A(instruction)], OS_VALUE_NUMBER(*left_value) + OS_VALUE_NUMBER(*right_value));
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_ADD_LL): // +
@@ -20239,7 +21739,7 @@ corrupted:
 				right_value = & stack_func_locals[OS_GETARG_C(instruction)];
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				OS_SET_VALUE_NUMBER(stack_func_locals[OS_GETARG_A(instruction)], OS_VALUE_NUMBER(*left_value) + OS_VALUE_NUMBER(*right_value));
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_COMPARE): // <=>
@@ -20257,7 +21757,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_SUB): // -
@@ -20270,7 +21770,7 @@ corrupted:
 				right_value = & OS_GETARG_C_VALUE();
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				OS_SET_VALUE_NUMBER(stack_func_locals[OS_GETARG_A(instruction)], OS_VALUE_NUMBER(*left_value) - OS_VALUE_NUMBER(*right_value));
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_SUB_LC): // -
@@ -20283,7 +21783,7 @@ corrupted:
 				right_value = & stack_func_prog_values[OS_GETARG_C(instruction)];
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				OS_SET_VALUE_NUMBER(stack_func_locals[OS_GETARG_A(instruction)], OS_VALUE_NUMBER(*left_value) - OS_VALUE_NUMBER(*right_value));
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_SUB_LL): // -
@@ -20296,7 +21796,7 @@ corrupted:
 				right_value = & stack_func_locals[OS_GETARG_C(instruction)];
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				OS_SET_VALUE_NUMBER(stack_func_locals[OS_GETARG_A(instruction)], OS_VALUE_NUMBER(*left_value) - OS_VALUE_NUMBER(*right_value));
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_MUL): // *
@@ -20313,7 +21813,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_MUL): // *
@@ -20326,7 +21826,7 @@ corrupted:
 				right_value = & OS_GETARG_C_VALUE();
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				OS_SET_VALUE_NUMBER(stack_func_locals[OS_GETARG_A(instruction)], OS_VALUE_NUMBER(*left_value) * OS_VALUE_NUMBER(*right_value));
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_DIV): // /
@@ -20348,7 +21848,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_DIV): // /
@@ -20366,7 +21866,7 @@ corrupted:
 				}else{
 					OS_SET_VALUE_NUMBER(stack_func_locals[OS_GETARG_A(instruction)], OS_VALUE_NUMBER(*left_value) / OS_VALUE_NUMBER(*right_value));
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_MOD): // %
@@ -20388,7 +21888,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_MOD): // %
@@ -20406,7 +21906,7 @@ corrupted:
 				}else{
 					stack_func_locals[OS_GETARG_A(instruction)] = OS_MATH_MOD_OPERATOR(OS_VALUE_NUMBER(*left_value), OS_VALUE_NUMBER(*right_value));
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_LSHIFT): // <<
@@ -20423,7 +21923,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_LSHIFT): // <<
@@ -20436,7 +21936,7 @@ corrupted:
 				right_value = & OS_GETARG_C_VALUE();
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				stack_func_locals[OS_GETARG_A(instruction)] = (OS_INT)OS_VALUE_NUMBER(*left_value) << (OS_INT)OS_VALUE_NUMBER(*right_value);
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_RSHIFT): // >>
@@ -20453,7 +21953,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_RSHIFT): // >>
@@ -20466,7 +21966,7 @@ corrupted:
 				right_value = & OS_GETARG_C_VALUE();
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				stack_func_locals[OS_GETARG_A(instruction)] = (OS_INT)OS_VALUE_NUMBER(*left_value) >> (OS_INT)OS_VALUE_NUMBER(*right_value);
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_POW): // **
@@ -20483,7 +21983,7 @@ corrupted:
 					pushOpResultValue((OpcodeType)OS_TO_OPCODE_TYPE(opcode), *left_value, *right_value);
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE_ALL(OP_NUMBER_POW): // **
@@ -20496,7 +21996,7 @@ corrupted:
 				right_value = & OS_GETARG_C_VALUE();
 				OS_ASSERT(OS_IS_VALUE_NUMBER(*left_value) && OS_IS_VALUE_NUMBER(*right_value));
 				stack_func_locals[OS_GETARG_A(instruction)] = OS_MATH_POW_OPERATOR(OS_VALUE_NUMBER(*left_value), OS_VALUE_NUMBER(*right_value));
-				break;
+				OS_NEXT_OPCODE_NOTHROW();
 			}
 
 		OS_CASE_OPCODE(OP_NEW_FUNCTION):
@@ -20522,7 +22022,7 @@ corrupted:
 					this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 				}
 				stack_func->opcodes += func_decl->opcodes_size;
-				break;
+				OS_NEXT_OPCODE();
 			}
 
 		OS_CASE_OPCODE(OP_CALL):
@@ -20533,7 +22033,9 @@ corrupted:
 			OS_ASSERT(b >= 2 && a+b <= stack_func->func->func_decl->stack_size);
 			c = OS_GETARG_C(instruction);
 			OS_ASSERT(c >= 0 && a+c <= stack_func->func->func_decl->stack_size);
-			callFT(stack_func->locals_stack_pos + a, b, c, NULL, OS_CALLENTER_ALLOW_ONLY_ENTER, OS_CALLTYPE_AUTO, OS_CALLTHIS_FUNCTION_OVERWRITE);
+			yield_call_pos = stack_func->locals_stack_pos + a;
+			callFT(yield_call_pos, b, c, NULL, OS_CALLENTER_ALLOW_ONLY_ENTER, OS_CALLTYPE_AUTO, OS_CALLTHIS_FUNCTION_OVERWRITE);
+			yield_call_pos = -1;
 			continue;
 
 #ifdef OS_TAIL_CALL_ENABLED
@@ -20615,7 +22117,9 @@ corrupted:
 			stack_func_locals[a + 1] = stack_func_locals[a]; // this
 			stack_func_locals[a] = stack_values.buf[--stack_values.count]; // func
 #endif
-			callFT(this->stack_func->locals_stack_pos + a, b, c, NULL, OS_CALLENTER_ALLOW_ONLY_ENTER, OS_CALLTYPE_AUTO, OS_CALLTHIS_KEEP_STACK_VALUE);
+			yield_call_pos = this->stack_func->locals_stack_pos + a;
+			callFT(yield_call_pos, b, c, NULL, OS_CALLENTER_ALLOW_ONLY_ENTER, OS_CALLTYPE_AUTO, OS_CALLTHIS_KEEP_STACK_VALUE);
+			yield_call_pos = -1;
 			continue;
 
 #ifdef OS_TAIL_CALL_ENABLED
@@ -20742,7 +22246,7 @@ corrupted:
 			a = OS_GETARG_A(instruction);
 			b = OS_GETARG_B(instruction);
 			stack_func_locals[a] = OS_GETARG_B_VALUE();
-			break;
+			OS_NEXT_OPCODE_NOTHROW();
 
 		OS_CASE_OPCODE_ALL(OP_MOVE2):
 			a = OS_GETARG_A(instruction);
@@ -20751,7 +22255,7 @@ corrupted:
 			c = OS_GETARG_C(instruction);
 			stack_func_locals[a] = OS_GETARG_B_VALUE();
 			stack_func_locals[a + 1] = OS_GETARG_C_VALUE();
-			break;
+			OS_NEXT_OPCODE_NOTHROW();
 
 		OS_CASE_OPCODE(OP_GET_XCONST):
 			// a = OS_GETARG_A(instruction);
@@ -20759,7 +22263,7 @@ corrupted:
 			// b = OS_GETARG_Bx(instruction);
 			OS_ASSERT(OS_GETARG_Bx(instruction) >= 0 && OS_GETARG_Bx(instruction) < stack_func->func->prog->num_numbers + stack_func->func->prog->num_strings + CONST_STD_VALUES);
 			stack_func_locals[OS_GETARG_A(instruction)] = stack_func_prog_values[OS_GETARG_Bx(instruction)];
-			break;
+			OS_NEXT_OPCODE_NOTHROW();
 
 		OS_CASE_OPCODE(OP_GET_UPVALUE):
 			// a = OS_GETARG_A(instruction);
@@ -20773,7 +22277,7 @@ corrupted:
 			OS_ASSERT(OS_GETARG_B(instruction) >= 0 && OS_GETARG_B(instruction) < scope->func_decl->num_locals);
 			OS_ASSERT(scope->func_decl->locals && scope->func_decl->locals[OS_GETARG_B(instruction)].upvalue);
 			stack_func_locals[OS_GETARG_A(instruction)] = scope->values[OS_GETARG_B(instruction)];
-			break;
+			OS_NEXT_OPCODE_NOTHROW();
 
 		OS_CASE_OPCODE(OP_SET_UPVALUE):
 			// a = OS_GETARG_A(instruction); // dest scope local
@@ -20791,7 +22295,7 @@ corrupted:
 			}else{
 				setValue(scope->values[OS_GETARG_A(instruction)], stack_func_locals[OS_GETARG_B(instruction)]);
 			}
-			break;
+			OS_NEXT_OPCODE_NOTHROW();
 
 		OS_CASE_OPCODE_ALL(OP_GET_PROPERTY):
 			// a = OS_GETARG_A(instruction);
@@ -20801,13 +22305,20 @@ corrupted:
 			c = OS_GETARG_C(instruction);
 #if 1 // performance optimization
 			index_value = &OS_GETARG_C_VALUE();
+			if((instruction & OS_OPCODE_CONST_C) && OS_VALUE_TYPE(*index_value) == OS_VALUE_TYPE_STRING){
+				prog = stack_func->func->prog;
+				if(getCachedPropertyValue(value, stack_func_locals[OS_GETARG_B(instruction)], *index_value, prog, (int)(stack_func->opcodes - prog->opcodes.buf) - 1)){
+					this->stack_func_locals[OS_GETARG_A(instruction)] = value;
+					OS_NEXT_OPCODE_NOTHROW();
+				}
+			}
 			OS_GETTER_VALUE(value, stack_func_locals[OS_GETARG_B(instruction)], *index_value, OS_VALUE_TYPE(*index_value), true, true);
 			this->stack_func_locals[OS_GETARG_A(instruction)] = value;
 #else
 			pushPropertyValue(stack_func_locals[OS_GETARG_B(instruction)], OS_GETARG_C_VALUE(), true, true);
 			this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
 #endif
-			break;
+			OS_NEXT_OPCODE();
 
 		OS_CASE_OPCODE_ALL(OP_INIT_PROPERTY):
 			// a = OS_GETARG_A(instruction);
@@ -20821,7 +22332,7 @@ corrupted:
 			setPropertyValue(value, OS_GETARG_B_VALUE(), OS_GETARG_C_VALUE(), false);
 			this->stack_func_locals[OS_GETARG_A(instruction)] = value;
 #endif
-			break;
+			OS_NEXT_OPCODE();
 
 		OS_CASE_OPCODE_ALL(OP_SET_PROPERTY):
 			// a = OS_GETARG_A(instruction);
@@ -20835,14 +22346,14 @@ corrupted:
 			setPropertyValue(value, OS_GETARG_B_VALUE(), OS_GETARG_C_VALUE(), true);
 			this->stack_func_locals[OS_GETARG_A(instruction)] = value;
 #endif
-			break;
+			OS_NEXT_OPCODE();
 
 		OS_CASE_OPCODE(OP_NEW_OBJECT):
 			// a = OS_GETARG_A(instruction);
 			OS_ASSERT(OS_GETARG_A(instruction) >= 0 && OS_GETARG_A(instruction) < stack_func->func->func_decl->stack_size);
 			pushObjectValue();
 			this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
-			break;
+			OS_NEXT_OPCODE();
 
 		OS_CASE_OPCODE(OP_NEW_ARRAY):
 			// a = OS_GETARG_A(instruction);
@@ -20850,7 +22361,7 @@ corrupted:
 			// b = OS_GETARG_B(instruction);
 			pushArrayValue(OS_GETARG_B(instruction));
 			this->stack_func_locals[OS_GETARG_A(instruction)] = stack_values.buf[--stack_values.count];
-			break;
+			OS_NEXT_OPCODE();
 
 		OS_CASE_OPCODE(OP_MULTI):
 			{
@@ -21944,6 +23455,7 @@ void OS::initCoreFunctions()
 					Core::Value class_value = os->core->getStackValue(-params);
 					// OS_ASSERT(OS_VALUE_VARIANT(right_value).value->prototype && OS_VALUE_VARIANT(right_value).value->prototype->ref_count > 0);
 					// OS_VALUE_VARIANT(right_value).value->prototype->ref_count--;
+					os->core->prototypeChanged(OS_VALUE_VARIANT(right_value).value);
 					os->core->setValue(OS_VALUE_VARIANT(right_value).value->prototype, class_value.getGCValue());
 					// OS_VALUE_VARIANT(right_value).value->prototype->ref_count++;
 					Core::Value instantiable;
@@ -22397,186 +23909,46 @@ void OS::initObjectClass()
 				if(self->table && objcomp){
 					os->core->sortTable(self->table, objcomp, user_param);
 				}
-				os->core->pushValue(self_var);
-				return 1;
-			}
-			return 0;
-		}
-
-		static int sort(OS * os, int params, int, int, void*)
-		{
-			if(params < 1){
-				return smartSort(os, params, Core::compareArrayValues, Core::comparePropValues);
-			}
-			String prop_name(os);
-			if(os->core->isValueString(os->core->getStackValue(-params), &prop_name)){
-				return smartSort(os, params, NULL, Core::compareObjectProperties, &prop_name);
-			}
-			return smartSort(os, params, Core::compareUserArrayValues, Core::compareUserPropValues);
-		}
-
-		static int length(OS * os, int params, int closure_values, int, void*)
-		{
-			Core::Value self_var = os->core->getStackValue(-params-closure_values-1);
-			Core::GCValue * self = self_var.getGCValue();
-			if(self){
-				os->pushNumber(self->table ? self->table->count : 0);
-				return 1;
-			}
-			return 0;
-		}
-
-		static int toJson(OS * os, int params, int, int, void*)
-		{
-			// allow usage with parameter toJson(v)
-			Core::Buffer buf(os);
-			Core::Value self_var = os->core->getStackValue(-params-1 + (params > 0));
-			OS_EValueType type = (OS_EValueType)OS_VALUE_TYPE(self_var);
-			if(type == OS_VALUE_TYPE_NULL){
-				os->pushString(os->core->strings->typeof_null);
-				return 1;
-			}			
-			if(params > 0){
-				Core::Value func_var = os->core->getStackValue(-params-2);
-				os->core->pushValue(self_var);
-				os->getProperty("toJson");
-				if(!os->core->isEqualExactly(func_var, os->core->getStackValue(-1))){
-					os->core->pushValue(self_var);
-					os->callFT(0, 1, OS_CALLTYPE_FUNC);
-#if 1
-					return 1;
-#else
-					self_var = os->core->getStackValue(-1);
-					type = (OS_EValueType)OS_VALUE_TYPE(self_var);
-					if(type == OS_VALUE_TYPE_STRING){
-						OS_ASSERT(dynamic_cast<Core::GCStringValue*>(OS_VALUE_VARIANT(self_var).string));
-						Core::GCStringValue * string = OS_VALUE_VARIANT(self_var).string;
-						if(string->getLen() >= 2 && (string->toChar()[0] == OS_TEXT('\"') || string->toChar()[0] == OS_TEXT('\''))){
-							return 1;
-						}
-						OS_ASSERT(false);
-					}
-#endif
-				}else{
-					os->pop();
-				}
-			}
-			switch(type){
-			// case OS_VALUE_TYPE_NULL:
-			default:
-				os->pushString(os->core->strings->typeof_null);
-				return 1;
-
-			case OS_VALUE_TYPE_BOOL:
-				os->pushString(OS_VALUE_VARIANT(self_var).boolean ? os->core->strings->syntax_true : os->core->strings->syntax_false);
-				return 1;
-
-			case OS_VALUE_TYPE_NUMBER:
-				os->pushString(OS::Core::String(os, (OS_FLOAT)OS_VALUE_NUMBER(self_var)));
-				return 1;
-
-			case OS_VALUE_TYPE_STRING:
-				OS_ASSERT(dynamic_cast<Core::GCStringValue*>(OS_VALUE_VARIANT(self_var).string));
-				os->core->appendQuotedString(buf, OS::Core::String(os, OS_VALUE_VARIANT(self_var).string));
-				os->pushString(buf.toString());
-				return 1;
-
-			case OS_VALUE_TYPE_ARRAY:
-				{
-					if(!os->core->pushValueOfRecursion(self_var)){
-						os->pushString(os->core->strings->typeof_null);
-						return 1;
-					}
-					struct Finalizer {
-						Core * core;
-						Core::Value val;
-						~Finalizer(){ core->popValueOfRecursion(val); }
-					} finalizer = {os->core, self_var}; (void)finalizer;
-
-					OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(self_var).arr));
-					Core::GCArrayValue * arr = OS_VALUE_VARIANT(self_var).arr;
-					buf += OS_TEXT("[");
-					for(int i = 0; i < arr->values.count && !os->isExceptionSet(); i++){
-						if(i > 0){
-							buf += OS_TEXT(",");
-						}						
-						os->pushCFunction(toJson);
-						os->core->pushValue(arr->values[i]);
-						os->callF(1, 1, OS_CALLTYPE_FUNC);
-						buf += os->popString();
-					}
-					if(!os->isExceptionSet()){
-						buf += OS_TEXT("]");
-					}
-					os->pushString(buf);
-					return 1;
-				}
-
-			case OS_VALUE_TYPE_USERDATA:
-			case OS_VALUE_TYPE_USERPTR:
-			case OS_VALUE_TYPE_OBJECT:
-				{
-					if(!os->core->pushValueOfRecursion(self_var)){
-						os->pushString(os->core->strings->typeof_null);
-						return 1;
-					}
-					struct Finalizer {
-						Core * core;
-						Core::Value val;
-						~Finalizer(){ core->popValueOfRecursion(val); }
-					} finalizer = {os->core, self_var}; (void)finalizer;
-
-					OS_ASSERT(dynamic_cast<Core::GCValue*>(OS_VALUE_VARIANT(self_var).value));
-					Core::GCValue * self = OS_VALUE_VARIANT(self_var).value;
-					buf += OS_TEXT("{");
-					Core::Property * prop = self->table ? self->table->first : NULL;
-					for(int i = 0; prop && !os->isExceptionSet(); prop = prop->next, i++){
-						if(i > 0){
-							buf += OS_TEXT(",");
-						}
-						switch(OS_VALUE_TYPE(prop->index)){
-						/* case OS_VALUE_TYPE_NULL:
-							buf += os->core->strings->typeof_null;
-							break; */
-
-						/* case OS_VALUE_TYPE_BOOL:
-							buf += OS_VALUE_VARIANT(prop->index).boolean ? os->core->strings->syntax_true : os->core->strings->syntax_false;
-							break; */
+				os->core->pushValue(self_var);
+				return 1;
+			}
+			return 0;
+		}
 
-						/* case OS_VALUE_TYPE_NUMBER:
-							buf += OS::Core::String(os, (OS_FLOAT)OS_VALUE_NUMBER(prop->index));
-							break; */
+		static int sort(OS * os, int params, int, int, void*)
+		{
+			if(params < 1){
+				return smartSort(os, params, Core::compareArrayValues, Core::comparePropValues);
+			}
+			String prop_name(os);
+			if(os->core->isValueString(os->core->getStackValue(-params), &prop_name)){
+				return smartSort(os, params, NULL, Core::compareObjectProperties, &prop_name);
+			}
+			return smartSort(os, params, Core::compareUserArrayValues, Core::compareUserPropValues);
+		}
 
-						case OS_VALUE_TYPE_NUMBER:
-						case OS_VALUE_TYPE_STRING:
-#if 1
-							os->pushCFunction(toJson);
-							os->core->pushValue(prop->index);
-							os->callF(1, 1, OS_CALLTYPE_FUNC);
-							buf += os->popString();
-#else
-							OS_ASSERT(dynamic_cast<Core::GCStringValue*>(OS_VALUE_VARIANT(prop->index).string));
-							os->core->appendQuotedString(buf, OS::Core::String(os, OS_VALUE_VARIANT(prop->index).string));
-#endif
-							break;
+		static int length(OS * os, int params, int closure_values, int, void*)
+		{
+			Core::Value self_var = os->core->getStackValue(-params-closure_values-1);
+			Core::GCValue * self = self_var.getGCValue();
+			if(self){
+				os->pushNumber(self->table ? self->table->count : 0);
+				return 1;
+			}
+			return 0;
+		}
 
-						default:
-							// skip value
-							continue;						
-						}
-						buf += OS_TEXT(":");
-						os->pushCFunction(toJson);
-						os->core->pushValue(prop->value);
-						os->callF(1, 1, OS_CALLTYPE_FUNC);
-						buf += os->popString();
-					}
-					if(!os->isExceptionSet()){
-						buf += OS_TEXT("}");
-					}
-					os->pushString(buf);
-					return 1;
-				}
+		static int toJson(OS * os, int params, int, int, void*)
+		{
+			// allow usage with parameter toJson(v)
+			Core::Buffer buf(os);
+			Core::Value self_var = os->core->getStackValue(-params-1 + (params > 0));
+			os->core->appendJson(buf, self_var, params > 0);
+			if(os->isExceptionSet()){
+				return 0;
 			}
+			os->pushString(buf);
+			return 1;
 		}
 
 		static int valueOf(OS * os, int params, int closure_values, int, void*)
@@ -22925,56 +24297,71 @@ dump_object:
 			return 1;
 		}
 
-		/* static int merge(OS * os, int params, int, int, void*)
+		static int merge(OS * os, int params, int, int, void*)
 		{
-			if(params < 1){
-				OS_ASSERT(params == 0);
-				// return this
-				return 1;
-			}
+			// deep and in place: objects and arrays that are already set get
+			// added to (this[k] += v), everything else is replaced; a value
+			// that refers back to itself is merged only once
 			int offs = os->getAbsoluteOffs(-params);
-			bool is_array = os->isArray(offs-1);
-			if(is_array || os->isObject(offs-1)){
-				for(int i = 0; i < params; i++){
-					Core::Value value = os->core->getStackValue(offs+i);
-					switch(OS_VALUE_TYPE(value)){
+			Core::Value self_var = os->core->getStackValue(offs-1);
+			if(!self_var.getGCValue()){
+				return 0;
+			}
+			for(int i = 0; i < params; i++){
+				Core::Value value = os->core->getStackValue(offs+i);
+				if(OS_VALUE_TYPE(value) != OS_VALUE_TYPE_OBJECT){
+					os->setException(String::format(os, OS_TEXT("Object.__add: Expected Object, got %s instead."), os->getTypeStr(offs+i).toChar()));
+					return 0;
+				}
+				OS_ASSERT(dynamic_cast<Core::GCObjectValue*>(OS_VALUE_VARIANT(value).object));
+				Core::Table * table = OS_VALUE_VARIANT(value).object->table;
+				if(!table || !os->core->pushValueOfRecursion(value)){
+					continue;
+				}
+				// __add may run script code, so work on a copy of the properties
+				Vector<Core::Value> captured_items;
+				os->vectorReserveCapacity(captured_items, table->count*2 OS_DBG_FILEPOS);
+				for(Core::Property * prop = table->first; prop; prop = prop->next){
+					os->vectorAddItem(captured_items, prop->index OS_DBG_FILEPOS);
+					os->vectorAddItem(captured_items, prop->value OS_DBG_FILEPOS);
+				}
+				os->core->retainValues(captured_items.buf, captured_items.count);
+				for(int j = 0; j < captured_items.count && !os->isExceptionSet(); j += 2){
+					Core::Value index = captured_items[j], item = captured_items[j+1];
+					os->pushStackValue(offs-1);
+					os->core->pushValue(index);
+					switch(OS_VALUE_TYPE(item)){
+					case OS_VALUE_TYPE_OBJECT:
 					case OS_VALUE_TYPE_ARRAY:
-						{
-							OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(value).arr));
-							for(int j = 0; j < OS_VALUE_VARIANT(value).arr->values.count; j++){
-								os->pushStackValue(offs-1);
-								os->core->pushValue(OS_VALUE_VARIANT(value).arr->values[j]);
-								os->addProperty();
-							}
+						if(os->core->isValueInValue(index, self_var)){
+							os->pushStackValue(-2);
+							os->pushStackValue(-2);
+							os->getProperty();
+							os->core->pushValue(item);
+							os->runOp(OP_ADD);
 							break;
 						}
+						// no break
 
-					case OS_VALUE_TYPE_OBJECT:
-						{
-							OS_ASSERT(dynamic_cast<Core::GCObjectValue*>(OS_VALUE_VARIANT(value).object));
-							if(OS_VALUE_VARIANT(value).object->table){
-								Core::Property * prop = OS_VALUE_VARIANT(value).object->table->first;
-								for(; prop; prop = prop->next){
-									os->pushStackValue(offs-1);
-									if(is_array){
-										os->core->pushValue(prop->value);
-										os->addProperty();
-									}else{
-										os->core->pushValue(prop->index);
-										os->core->pushValue(prop->value);
-										os->setProperty();
-									}
-								}
-							}
-							break;
-						}
+					default:
+						os->core->pushValue(item);
+					}
+					if(os->isExceptionSet()){
+						os->pop(3);
+					}else{
+						os->setProperty();
 					}
 				}
-				os->pushStackValue(offs-1);
-				return 1;
+				os->core->releaseValues(captured_items.buf, captured_items.count);
+				os->vectorClear(captured_items);
+				os->core->popValueOfRecursion(value);
+				if(os->isExceptionSet()){
+					return 0;
+				}
 			}
-			return 0;
-		} */
+			os->pushStackValue(offs-1);
+			return 1;
+		}
 
 		static int getKeys(OS * os, int params, int, int, void*)
 		{
@@ -23035,15 +24422,7 @@ dump_object:
 			case OS_VALUE_TYPE_USERPTR:
 			case OS_VALUE_TYPE_FUNCTION:
 			case OS_VALUE_TYPE_CFUNCTION:
-				if(OS_VALUE_VARIANT(self_var).object->table){
-					Core::Property * prop = OS_VALUE_VARIANT(self_var).object->table->first;
-					for(int i = 0; prop; prop = prop->next, i++){
-						if(i > 0){
-							buf.append(str);
-						}
-						buf.append(os->core->valueToString(prop->value, true));
-					}
-				}
+				os->core->appendJoined(buf, self_var, str);
 				os->pushString(buf);
 				return 1;
 			}
@@ -23279,7 +24658,8 @@ dump_object:
 		{OS_TEXT("hasOwnProperty"), Object::hasOwnProperty},
 		{OS_TEXT("hasProperty"), Object::hasProperty},
 		{OS_TEXT("sub"), Object::sub},
-		// {OS_TEXT("merge"), Object::merge},
+		{OS_TEXT("merge"), Object::merge},
+		{core->strings->__add, Object::merge},
 		{OS_TEXT("join"), Object::join},
 		{OS_TEXT("clear"), Object::clear},
 		{OS_TEXT("__get@keys"), Object::getKeys},
@@ -23585,6 +24965,86 @@ void OS::initArrayClass()
 			return 0;
 		}
 
+		// the number of items adding values would give: arrays count with their items
+		static int countItems(OS * os, int offs, int count)
+		{
+			int items = 0;
+			for(int i = 0; i < count; i++){
+				Core::Value value = os->core->getStackValue(offs+i);
+				items += OS_VALUE_TYPE(value) == OS_VALUE_TYPE_ARRAY ? OS_VALUE_VARIANT(value).arr->values.count : 1;
+			}
+			return items;
+		}
+
+		static void append(OS * os, Core::GCArrayValue * arr, const Core::Value& value)
+		{
+			if(OS_VALUE_TYPE(value) != OS_VALUE_TYPE_ARRAY){
+				os->core->retainValue(value);
+				os->vectorAddItem(arr->values, value OS_DBG_FILEPOS);
+				return;
+			}
+			OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(value).arr));
+			Core::GCArrayValue * items = OS_VALUE_VARIANT(value).arr;
+			int count = items->values.count; // items may be arr itself
+			os->vectorReserveCapacity(arr->values, arr->values.count + count OS_DBG_FILEPOS);
+			OS_MEMCPY(arr->values.buf + arr->values.count, items->values.buf, sizeof(Core::Value)*count);
+			os->core->retainValues(arr->values.buf + arr->values.count, count);
+			arr->values.count += count;
+		}
+
+		static int concat(OS * os, int params, int, int, void*)
+		{
+			int offs = os->getAbsoluteOffs(-params);
+			if(os->isArray(offs-1)){
+				Core::GCArrayValue * arr = os->core->pushArrayValue(countItems(os, offs-1, params+1));
+				for(int i = -1; i < params; i++){
+					append(os, arr, os->core->getStackValue(offs+i));
+				}
+				return 1;
+			}
+			return 0;
+		}
+
+		static int extend(OS * os, int params, int, int, void*)
+		{
+			int offs = os->getAbsoluteOffs(-params);
+			Core::Value self_var = os->core->getStackValue(offs-1);
+			if(OS_VALUE_TYPE(self_var) == OS_VALUE_TYPE_ARRAY){
+				OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(self_var).arr));
+				Core::GCArrayValue * arr = OS_VALUE_VARIANT(self_var).arr;
+				os->vectorReserveCapacity(arr->values, arr->values.count + countItems(os, offs, params) OS_DBG_FILEPOS);
+				for(int i = 0; i < params; i++){
+					append(os, arr, os->core->getStackValue(offs+i));
+				}
+				os->core->pushValue(self_var);
+				return 1;
+			}
+			return 0;
+		}
+
+		static int unique(OS * os, int params, int, int, void*)
+		{
+			Core::Value self_var = os->core->getStackValue(-params-1);
+			if(OS_VALUE_TYPE(self_var) == OS_VALUE_TYPE_ARRAY){
+				OS_ASSERT(dynamic_cast<Core::GCArrayValue*>(OS_VALUE_VARIANT(self_var).arr));
+				Core::GCArrayValue * self = OS_VALUE_VARIANT(self_var).arr;
+				Core::GCArrayValue * arr = os->core->pushArrayValue();
+				// values are the same if they would be the same key of an object
+				Core::Table * seen = os->core->newTable(OS_DBG_FILEPOS_START);
+				for(int i = 0; i < self->values.count; i++){
+					Core::Value value = self->values[i];
+					if(!seen->get(value, OS_VALUE_TYPE(value))){
+						os->core->addTableProperty(seen, value, Core::Value());
+						os->core->retainValue(value);
+						os->vectorAddItem(arr->values, value OS_DBG_FILEPOS);
+					}
+				}
+				os->core->deleteTable(seen);
+				return 1;
+			}
+			return 0;
+		}
+
 		static int indexOf(OS * os, int params, int, int, void*)
 		{
 			Core::Value self_var = os->core->getStackValue(-params-1);
@@ -23640,12 +25100,7 @@ void OS::initArrayClass()
 			Core::Value self_var = os->core->getStackValue(-params-1);
 			switch(OS_VALUE_TYPE(self_var)){
 			case OS_VALUE_TYPE_ARRAY:
-				for(int i = 0; i < OS_VALUE_VARIANT(self_var).arr->values.count; i++){
-					if(i > 0){
-						buf.append(str);
-					}
-					buf.append(os->core->valueToString(OS_VALUE_VARIANT(self_var).arr->values[i], true));
-				}
+				os->core->appendJoined(buf, self_var, str);
 				os->pushString(buf);
 				return 1;
 			}
@@ -23812,6 +25267,10 @@ void OS::initArrayClass()
 		{OS_TEXT("shift"), Array::shift},
 		{OS_TEXT("indexOf"), Array::indexOf},
 		{OS_TEXT("lastIndexOf"), Array::lastIndexOf},
+		{OS_TEXT("concat"), Array::concat},
+		{OS_TEXT("extend"), Array::extend},
+		{core->strings->__add, Array::extend},
+		{OS_TEXT("unique"), Array::unique},
 		{OS_TEXT("join"), Array::join},
 		{OS_TEXT("__get@keys"), Array::getKeys},
 		{OS_TEXT("getKeys"), Array::getKeys},
@@ -23862,7 +25321,7 @@ void OS::initBufferClass()
 		{
 			Core::Buffer * self = new (os->malloc(sizeof(Core::Buffer) OS_DBG_FILEPOS)) Core::Buffer(os);
 			for(int i = 0; i < params; i++){
-				self->append(os->toString(-params + i));
+				os->core->appendValueString(*self, os->core->getStackValue(-params + i));
 			}
 			CtypeValue<Core::Buffer*>::push(os, self);
 			return 1;
@@ -23872,12 +25331,38 @@ void OS::initBufferClass()
 		{
 			OS_GET_SELF(Core::Buffer*);
 			for(int i = 0; i < params; i++){
-				self->append(os->toString(-params + i));
+				os->core->appendValueString(*self, os->core->getStackValue(-params + i));
 			}
 			CtypeValue<Core::Buffer*>::push(os, self);
 			return 1;
 		}
 
+		static int join(OS * os, int params, int, int, void * user_param)
+		{
+			// buf.join(list, separator)
+			OS_GET_SELF(Core::Buffer*);
+			String separator = params >= 2 ? os->toString(-params+1) : String(os);
+			os->core->appendJoined(*self, os->core->getStackValue(-params+0), separator);
+			os->pushStackValue(-params-1);
+			return 1;
+		}
+
+		static int format(OS * os, int params, int, int, void * user_param)
+		{
+			// buf.format(fmt, ...) appends sprintf(fmt, ...)
+			OS_GET_SELF(Core::Buffer*);
+			int offs = os->getAbsoluteOffs(-params);
+			os->getGlobal(OS_TEXT("sprintf"));
+			os->pushGlobals();
+			for(int i = 0; i < params; i++){
+				os->pushStackValue(offs + i);
+			}
+			os->callFT(params, 1, OS_CALLTYPE_FUNC);
+			self->append(os->popString());
+			os->pushStackValue(offs - 1);
+			return 1;
+		}
+
 		static int clear(OS * os, int params, int, int, void * user_param)
 		{
 			OS_GET_SELF(Core::Buffer*);
@@ -23913,8 +25398,11 @@ void OS::initBufferClass()
 	OS::FuncDef funcs[] = {
 		{core->strings->__newinstance, Lib::__newinstance},
 		{OS_TEXT("append"), Lib::append},
+		{OS_TEXT("join"), Lib::join},
+		{OS_TEXT("format"), Lib::format},
 		{OS_TEXT("clear"), Lib::clear},
 		{core->strings->func_valueOf, Lib::valueOf},
+		{OS_TEXT("toString"), Lib::valueOf},
 		{core->strings->__len, Lib::len},
 		// {OS_TEXT("printf"), Lib::printf},
 		{}
@@ -23924,6 +25412,10 @@ void OS::initBufferClass()
 	getGlobal(CtypeName<Core::Buffer>::getName());
 	core->pushValue(core->prototypes[Core::PROTOTYPE_STRING]);
 	setPrototype(CtypeId<Core::Buffer>::getId());
+
+	// the same class under the usual name of a mutable string
+	getGlobal(CtypeName<Core::Buffer>::getName());
+	setGlobal(OS_TEXT("StringBuilder"));
 }
 
 #define UTF8_SKIP_MULTI_BYTE_SEQUENCE(input, end) \
@@ -25180,7 +26672,9 @@ void OS::initStringClass()
 		}
 	};
 
-	PackLib::init();
+	// the byte maps are shared by all interpreters, fill them once
+	static bool pack_ready = (PackLib::init(), true);
+	(void)pack_ready;
 
 	FuncDef list[] = {
 		{core->strings->__construct, String::construct},
@@ -25988,12 +27482,12 @@ void OS::initJsonModule()
 		static int encode(OS * os, int params, int, int, void*)
 		{
 			if(params > 0){
-				int offs = os->getAbsoluteOffs(-params+0);
-				os->getGlobal(OS_TEXT("Object"));
-				os->getProperty(OS_TEXT("toJson"));
-				os->pushNull();
-				os->pushStackValue(offs);
-				os->callFT(1, 1, OS_CALLTYPE_FUNC);
+				Core::Buffer buf(os);
+				os->core->appendJson(buf, os->core->getStackValue(-params+0), true);
+				if(os->isExceptionSet()){
+					return 0;
+				}
+				os->pushString(buf);
 				return 1;
 			}
 			return 0;
@@ -26002,36 +27496,14 @@ void OS::initJsonModule()
 		static int decode(OS * os, int params, int, int, void*)
 		{
 			if(params > 0){
-				int ret = 0;
-				OS * new_os = OS::create(os->memory_manager);
-				{
-					OS::Core::Buffer buf(new_os);
-					buf += OS_TEXT("return (");
-					OS::String str = os->toString(-params+0);
-					if(str.getLen() >= 3 && OS_STRNCMP(str.toChar(), OS_TEXT("\xef\xbb\xbf"), 3) == 0){
-						buf.append(str.toChar()+3, str.getLen()-3); // skip utf8 BOM
-					}else{
-						buf += str;
-					}
-					buf += OS_TEXT(")");
-
-					new_os->compile(buf.toStringOS(), OS_SOURCECODE_PLAIN, false);
-					/* new_os->getGlobal(OS_TEXT("compileText"));
-					new_os->pushGlobals();
-					new_os->pushString(buf);
-					new_os->pushNumber(OS_SOURCECODE_PLAIN);
-					new_os->pushBool(false);
-					new_os->call(3, 1); */
-				}
-				if(new_os->isFunction()){
-					new_os->pushNull();
-					new_os->callFT(0, 1, OS_CALLTYPE_FUNC);
-					os->core->pushCloneValueFrom(new_os, new_os->core->getStackValue(-1));
-					ret = 1;
-				}
-				new_os->pop();
-				new_os->release();
-				return ret;
+				OS::String str = os->toString(-params+0);
+				const OS_CHAR * text = str.toChar();
+				int len = str.getLen();
+				if(len >= 3 && OS_STRNCMP(text, OS_TEXT("\xef\xbb\xbf"), 3) == 0){
+					text += 3; // skip utf8 BOM
+					len -= 3;
+				}
+				return os->core->pushJsonValue(text, len) ? 1 : 0;
 			}
 			return 0;
 		}
@@ -26099,6 +27571,38 @@ void OS::initGCModule()
 			}
 			return 0;
 		}
+		static int getPause(OS * os, int params, int, int, void*)
+		{
+			os->pushNumber(os->getGCPause());
+			return 1;
+		}
+		static int setPause(OS * os, int params, int, int, void*)
+		{
+			if(params > 0){
+				os->setGCPause(os->toInt(-params+0));
+			}
+			return 0;
+		}
+		static int getCycles(OS * os, int params, int, int, void*)
+		{
+			os->pushNumber(os->core->gc_cycles);
+			return 1;
+		}
+		static int getTotalTime(OS * os, int params, int, int, void*)
+		{
+			os->pushNumber(os->core->gc_total_time);
+			return 1;
+		}
+		static int getLastPause(OS * os, int params, int, int, void*)
+		{
+			os->pushNumber(os->core->gc_last_pause);
+			return 1;
+		}
+		static int getMaxPause(OS * os, int params, int, int, void*)
+		{
+			os->pushNumber(os->core->gc_max_pause);
+			return 1;
+		}
 		static int getValueBytes(OS * os, int params, int, int, void*)
 		{
 			os->pushNumber(sizeof(Core::Value));
@@ -26129,6 +27633,12 @@ void OS::initGCModule()
 		{OS_TEXT("__get@numDestroyedObjects"), GC::getNumDestroyedObjects},
 		{OS_TEXT("__get@startWhenUsedBytes"), GC::getStartWhenUsedBytes},
 		{OS_TEXT("__set@startWhenUsedBytes"), GC::setStartWhenUsedBytes},
+		{OS_TEXT("__get@pause"), GC::getPause},
+		{OS_TEXT("__set@pause"), GC::setPause},
+		{OS_TEXT("__get@cycles"), GC::getCycles},
+		{OS_TEXT("__get@totalTime"), GC::getTotalTime},
+		{OS_TEXT("__get@lastPause"), GC::getLastPause},
+		{OS_TEXT("__get@maxPause"), GC::getMaxPause},
 		{OS_TEXT("__get@valueBytes"), GC::getValueBytes},
 		{OS_TEXT("__get@isNanTrickUsed"), GC::getNanTrickUsed},
 		{OS_TEXT("full"), GC::full},
@@ -26140,6 +27650,156 @@ void OS::initGCModule()
 	pop();
 }
 
+void OS::initCoroutineModule()
+{
+	static int coroutine_crc = OS_PTR_HASH(&coroutine_crc);
+	struct CoroutineLib
+	{
+		static void destruct(OS * os, void * data, void * user_param)
+		{
+			Core::Coroutine * co = (Core::Coroutine*)data;
+			os->core->clearCoroutine(co);
+			co->~Coroutine();
+		}
+
+		static Core::Coroutine * toCoroutine(OS * os, int offs)
+		{
+			Core::Coroutine * co = (Core::Coroutine*)os->toUserdata(coroutine_crc, offs);
+			if(!co){
+				os->setException(OS_TEXT("coroutine expected"));
+			}
+			return co;
+		}
+
+		static int create(OS * os, int params, int, int, void*)
+		{
+			// create(func [, this])
+			if(params < 1 || !os->isFunction(-params)){
+				os->setException(OS_TEXT("function expected"));
+				return 0;
+			}
+			Core * core = os->core;
+			Core::Value func = core->getStackValue(-params);
+			Core::Value self = params > 1 ? core->getStackValue(-params+1) : Core::Value();
+			Core::Coroutine * co = new (os->pushUserdata(coroutine_crc, sizeof(Core::Coroutine), destruct)) Core::Coroutine();
+			co->status = Core::Coroutine::NEW;
+			co->base = 0;
+			co->yield_slot = -1;
+			co->ret_stack_funcs = 0;
+			co->resumer = NULL;
+			os->vectorAddItem(co->values, func OS_DBG_FILEPOS);
+			os->vectorAddItem(co->values, self OS_DBG_FILEPOS);
+			core->retainValues(co->values.buf, co->values.count);
+			core->linkCoroutine(co);
+			return 1;
+		}
+
+		static int resume(OS * os, int params, int, int, void*)
+		{
+			// resume(co, ...) returns the yielded or the returned value
+			Core::Coroutine * co = params > 0 ? toCoroutine(os, -params) : NULL;
+			if(!co){
+				if(params < 1) os->setException(OS_TEXT("coroutine expected"));
+				return 0;
+			}
+			if(co->status == Core::Coroutine::RUNNING || co->status == Core::Coroutine::DEAD){
+				os->setException(co->status == Core::Coroutine::DEAD ? OS_TEXT("can't resume dead coroutine") : OS_TEXT("can't resume running coroutine"));
+				return 0;
+			}
+			Core * core = os->core;
+			int offs = os->getAbsoluteOffs(-params+1), count = params-1;
+			co->resumer = core->running_coroutine;
+			if(co->status == Core::Coroutine::NEW){
+				core->pushValue(co->values[0]);
+				core->pushValue(co->values[1]);
+				for(int i = 0; i < count; i++){
+					os->pushStackValue(offs + i);
+				}
+				core->unlinkCoroutine(co);
+				core->releaseValues(co->values.buf, co->values.count);
+				os->vectorClear(co->values);
+				co->status = Core::Coroutine::RUNNING;
+				co->ret_stack_funcs = core->call_stack_funcs.count;
+				core->running_coroutine = co;
+				core->callFT(count, 1, OS_CALLTYPE_FUNC, OS_CALLTHIS_KEEP_STACK_VALUE);
+			}else{
+				int start = core->stack_values.count;
+				core->restoreCoroutine(co, count > 0 ? core->getStackValue(offs) : Core::Value());
+				core->running_coroutine = co;
+				core->execute(co->ret_stack_funcs);
+				core->stack_values.count = start + 1;
+			}
+			core->running_coroutine = co->resumer;
+			co->resumer = NULL;
+			if(co->status == Core::Coroutine::RUNNING){
+				co->status = Core::Coroutine::DEAD;
+			}
+			return os->isExceptionSet() ? 0 : 1;
+		}
+
+		static int yield(OS * os, int params, int, int need_ret_values, void*)
+		{
+			// yield([value]) suspends the running coroutine, resume returns value
+			Core * core = os->core;
+			if(!core->running_coroutine){
+				os->setException(OS_TEXT("coroutine.yield outside of a coroutine"));
+				return 0;
+			}
+			int start_pos = core->stack_values.count - params - 2;
+			if(start_pos != core->yield_call_pos){
+				os->setException(OS_TEXT("coroutine.yield must be called directly"));
+				return 0;
+			}
+			core->setValue(core->yield_value, params > 0 ? core->getStackValue(-params) : Core::Value());
+			core->yield_slot_pos = need_ret_values > 0 ? start_pos : -1;
+			core->yield_requested = true;
+			return 0;
+		}
+
+		static int status(OS * os, int params, int, int, void*)
+		{
+			Core::Coroutine * co = params > 0 ? toCoroutine(os, -params) : NULL;
+			if(!co){
+				return 0;
+			}
+			switch(co->status){
+			case Core::Coroutine::NEW:
+			case Core::Coroutine::SUSPENDED:
+				os->pushString(OS_TEXT("suspended"));
+				break;
+
+			case Core::Coroutine::RUNNING:
+				os->pushString(OS_TEXT("running"));
+				break;
+
+			default:
+				os->pushString(OS_TEXT("dead"));
+			}
+			return 1;
+		}
+
+		static int isYieldable(OS * os, int params, int, int, void*)
+		{
+			// a native call in between (call, apply, sort...) runs a nested execute() that yield can't cross
+			Core * core = os->core;
+			os->pushBool(core->running_coroutine && core->running_coroutine->ret_stack_funcs == core->execute_ret_stack_funcs);
+			return 1;
+		}
+	};
+	FuncDef list[] = {
+		{OS_TEXT("create"), CoroutineLib::create},
+		{OS_TEXT("resume"), CoroutineLib::resume},
+		{OS_TEXT("yield"), CoroutineLib::yield},
+		{OS_TEXT("status"), CoroutineLib::status},
+		{OS_TEXT("isYieldable"), CoroutineLib::isYieldable},
+		{}
+	};
+
+	getModule(OS_TEXT("coroutine"));
+	setFuncs(list);
+	pop();
+}
+
 void OS::initLangTokenizerModule()
 {
 	struct LangTokenizer
@@ -26619,7 +28279,7 @@ void OS::Core::callFT(int start_pos, int call_params, int ret_values, GCValue *
 					OS_ASSERT(call_stack_funcs.capacity >= call_stack_funcs.count+1);
 
 					StackFunction * new_buf = (StackFunction*)malloc(sizeof(StackFunction)*call_stack_funcs.capacity OS_DBG_FILEPOS);
-					OS_MEMCPY(new_buf, call_stack_funcs.buf, sizeof(StackFunction) * call_stack_funcs.count);
+					OS_MEMCPY((void*)new_buf, call_stack_funcs.buf, sizeof(StackFunction) * call_stack_funcs.count);
 					free(call_stack_funcs.buf);
 					call_stack_funcs.buf = new_buf;
 				}
@@ -26725,12 +28385,19 @@ void OS::Core::callFT(int start_pos, int call_params, int ret_values, GCValue *
 				}
 				stack_values.count = start_pos + call_params + cfunc_value->num_closure_values;
 				int cur_ret_values;
+				OS_NativeCallCallback native_call_callback = this->native_call_callback;
+				if(native_call_callback){
+					native_call_callback(allocator, cfunc_value->func, cfunc_value->user_param, true, native_call_user_param);
+				}
 				try{
 					cur_ret_values = cfunc_value->func(allocator, call_params - 2, cfunc_value->num_closure_values, ret_values, cfunc_value->user_param);
 				}catch(...){
 					cur_ret_values = 0;
 					allocator->setException(OS_TEXT("internal error"));
 				}
+				if(native_call_callback){
+					native_call_callback(allocator, cfunc_value->func, cfunc_value->user_param, false, native_call_user_param);
+				}
 	#if 0		// do save closure values?
 				if(cfunc_value->num_closure_values > 0){
 					Value * closure_values = (Value*)(cfunc_value + 1);
@@ -26893,7 +28560,10 @@ bool OS::compileFile(const String& p_filename, bool required, OS_ESourceCodeType
 {
 	String filename = resolvePath(p_filename);
 	bool is_compiled = getFilenameExt(filename) == OS_EXT_COMPILED;
-	String compiled_filename = is_compiled ? filename : getCompiledFilename(filename);
+	if(source_code_type == OS_SOURCECODE_AUTO){
+		source_code_type = getSourceCodeType(filename);
+	}
+	String compiled_filename = is_compiled ? filename : getCompiledFilename(filename, source_code_type);
 	bool sourcecode_file_exist = is_compiled ? false : isFileExist(filename);
 	bool compiled_file_exist = isFileExist(compiled_filename);
 	bool recompile_enabled = false;
@@ -26949,10 +28619,6 @@ bool OS::compileFile(const String& p_filename, bool required, OS_ESourceCodeType
 	Core::MemStreamWriter file_data(this);
 	file_data.writeFromStream(&file);
 
-	if(source_code_type == OS_SOURCECODE_AUTO){
-		source_code_type = getSourceCodeType(filename);
-	}
-
 	Core::Tokenizer tokenizer(this);
 	tokenizer.parseText((OS_CHAR*)file_data.buffer.buf, file_data.buffer.count, filename, true, source_code_type, check_utf8_bom);
 
@@ -27112,6 +28778,9 @@ int OS::getSetting(OS_ESettings setting)
 
 	case OS_SETTING_SOURCECODE_MUST_EXIST:
 		return core->settings.sourcecode_must_exist;
+
+	case OS_SETTING_COMPILE_DEBUG_CALLS:
+		return core->settings.compile_debug_calls;
 	}
 	return -1;
 }
@@ -27146,6 +28815,9 @@ int OS::setSetting(OS_ESettings setting, int value)
 	case OS_SETTING_SOURCECODE_MUST_EXIST:
 		return Lib::ret(core->settings.sourcecode_must_exist, value);
 
+	case OS_SETTING_COMPILE_DEBUG_CALLS:
+		return Lib::ret(core->settings.compile_debug_calls, value);
+
 	default:
 		OS_ASSERT(false);
 	}
@@ -27168,6 +28840,16 @@ int OS::getGCStartWhenUsedBytes()
 	return core->gc_start_when_used_bytes;
 }
 
+void OS::setGCPause(int percent)
+{
+	core->gc_pause = percent > 110 ? percent : 110;
+}
+
+int OS::getGCPause()
+{
+	return core->gc_pause;
+}
+
 // =====================================================================
 // =====================================================================
 // =====================================================================
@@ -164,6 +164,14 @@ inline void operator delete(void *, void *){}
 // uncomment it if need
 // #define OS_INFINITE_LOOP_OPCODES 100000000
 
+// jump from opcode to opcode through a table of label addresses instead of
+// the switch, GCC and Clang only; comment it out to use the switch
+#define OS_THREADED_DISPATCH
+
+#if defined OS_THREADED_DISPATCH && (!defined __GNUC__ || defined OS_DEBUG || defined OS_INFINITE_LOOP_OPCODES)
+#undef OS_THREADED_DISPATCH
+#endif
+
 #ifdef OS_DEBUG
 #define OS_DEF_MAX_CALL_STACK_SIZE 80
 #else
@@ -171,6 +179,9 @@ inline void operator delete(void *, void *){}
 #endif
 
 #define OS_COMPILED_HEADER OS_TEXT("OBJECTSCRIPT")
+// Bump when the opcodes, their operands or the code the compiler emits
+// change, so that cached bytecode of an older build is not run.
+#define OS_BYTECODE_VERSION 1
 #define OS_EXT_SOURCECODE OS_TEXT(".os")
 #define OS_EXT_TEMPLATE OS_TEXT(".osh")
 #define OS_EXT_TEMPLATE_HTML OS_TEXT(".html")
@@ -235,6 +246,8 @@ namespace ObjectScript
 
 	typedef void (*OS_UserdataDtor)(OS*, void * data, void * user_param);
 	typedef int (*OS_CFunction)(OS*, int params, int closure_values, int need_ret_values, void * user_param);
+	typedef void (*OS_SampleCallback)(OS*, void * user_param);
+	typedef void (*OS_NativeCallCallback)(OS*, OS_CFunction func, void * func_user_param, bool enter, void * user_param);
 
 	enum OS_ESettings
 	{
@@ -244,6 +257,7 @@ namespace ObjectScript
 		OS_SETTING_CREATE_COMPILED_FILE,
 		OS_SETTING_PRIMARY_COMPILED_FILE,
 		OS_SETTING_SOURCECODE_MUST_EXIST,
+		OS_SETTING_COMPILE_DEBUG_CALLS, // if 0, calls of the global function debug are compiled to nothing
 	};
 
 	enum OS_EValueType
@@ -1078,6 +1092,7 @@ namespace ObjectScript
 					OS * allocator;
 					String filename;
 					bool is_real_file;
+					OS_ESourceCodeType source_code_type;
 					Vector<String> lines;
 
 					int ref_count;
@@ -1201,6 +1216,25 @@ namespace ObjectScript
 
 			struct Property;
 			struct Value;
+
+			// Tables which got the same string keys in the same order share a
+			// shape. It maps the keys to slots of a property block per table,
+			// so such tables need no hash buckets and no allocation per key.
+			struct Shape
+			{
+				Shape * parent;
+				Shape * hash_next; // in Core::shapes
+				Value * keys; // keys[count-1] was added last
+				int * slots; // open addressing into keys, -1 if empty
+				int slot_mask;
+				int count;
+				Shape * child; // the only shape that adds a key to this one, NULL if there are none or several
+				bool branched;
+
+				int find(const Value& index, int index_type) const;
+				int getBlockSize() const;
+			};
+
 			struct Table
 			{
 				struct IteratorState
@@ -1214,20 +1248,42 @@ namespace ObjectScript
 					~IteratorState();
 				};
 
-				Property ** heads;
+				Property ** heads; // NULL while the table has a shape
 				int head_mask;
+				int head_deleted;
 				int count;
 				OS_INT next_index;
 
+				// Properties of the block, in chunks that never move: native code
+				// walking first/next may call script that adds keys
+				struct Chunk
+				{
+					Chunk * next;
+					int size;
+
+					Property * getProperties();
+				};
+
+				Shape * shape;
+				Property ** block; // block[i] holds the shape's i-th key, kept when the table leaves its shape
+				int block_size;
+				Chunk * chunks;
+
 				Property * first, * last;
 				IteratorState * iterators;
 
+				bool has_accessors; // a __set, __set@ or __get@ key was ever added
+				bool in_property_cache; // holds or passes on a cached prototype property
+				int version; // changes whenever a key is added, removed or renamed
+
 				Table();    
 				~Table();
 
 				// Property * get(const Value& index);
 				Property * get(const Value& index, int index_type);
 
+				bool isInBlock(Property*) const;
+
 				bool containsIterator(IteratorState*);
 				void addIterator(IteratorState*);
 				void removeIterator(IteratorState*);
@@ -1254,6 +1310,7 @@ namespace ObjectScript
 				OS_EValueType type;
 				// bool is_object_instance;
 				bool is_destructor_called;
+				bool is_accessor_cached; // part of a prototype chain in the accessor cache
 
 				// EGCColor gc_color;
 
@@ -1510,7 +1567,6 @@ namespace ObjectScript
 				Value index;
 				Value value;
 
-				Property * hash_next;
 				Property * prev, * next;
 
 				Property(const Value& index, const Value& value);
@@ -2253,6 +2309,30 @@ namespace ObjectScript
 				~FunctionDecl();
 			};
 
+			// Inline cache of a get-property opcode. An entry remembers where
+			// the property of one receiver object lives.
+			struct PropertyCacheEntry
+			{
+				int value_id; // receiver
+				int table_version; // receiver's own table, 0 if it has none
+				Property * prop;
+				int epoch; // 0 for own properties, else property_cache_epoch
+				Shape * shape; // any receiver of this shape has the property in block[slot]
+				int slot;
+			};
+
+			enum {
+				PROPERTY_CACHE_WAYS = 2,
+				PROPERTY_CACHE_MAX_MISSES = 32, // more than hits, then the opcode is megamorphic and not cached
+				PROPERTY_CACHE_RETRY_AFTER = 1024 // lookups until a megamorphic opcode is tried again
+			};
+
+			struct PropertyCache
+			{
+				int misses; // less one per hit
+				PropertyCacheEntry entries[PROPERTY_CACHE_WAYS];
+			};
+
 			class Program
 			{
 			protected:
@@ -2275,6 +2355,8 @@ namespace ObjectScript
 				int num_functions;
 
 				Vector<OS_U32> opcodes;
+				int * property_cache_slots; // per opcode, 0 or the index+1 in property_caches
+				Vector<PropertyCache> property_caches;
 				
 				struct DebugInfoItem
 				{
@@ -2357,6 +2439,29 @@ namespace ObjectScript
 				OS_U32 * opcodes;
 			};
 
+			// A suspended coroutine keeps its frames and their slice of the stack
+			// off the interpreter stacks until it is resumed
+			struct Coroutine
+			{
+				enum EStatus
+				{
+					NEW,
+					SUSPENDED,
+					RUNNING,
+					DEAD
+				};
+
+				EStatus status;
+				Vector<Value> values; // func and this while NEW, the stack slice while SUSPENDED
+				Vector<StackFunction> frames;
+				int base; // stack position the slice was taken from
+				int yield_slot; // where the resume value goes, -1 if the yield result is unused
+				int ret_stack_funcs; // frames below it belong to the resumer
+				Coroutine * resumer;
+				Coroutine * prev; // NEW and SUSPENDED coroutines are gc roots
+				Coroutine * next;
+			};
+
 			/* struct StringRef
 			{
 				int string_hash;
@@ -2496,6 +2601,7 @@ namespace ObjectScript
 				String func_echo;
 				String func_require;
 				String func_call;
+				String func_debug;
 				String func_core;
 				String func_main;
 				String func_defineConstProperty;
@@ -2642,10 +2748,55 @@ namespace ObjectScript
 			};
 
 			FreeCandidateValues gc_candidate_values;
+
+			// Remembers prototype chains that have no accessor for a name,
+			// so plain property stores and misses skip building "__set@name"
+			// and "__get@name" and walking the chain for them.
+			enum {
+				ACCESSOR_CACHE_SIZE = 1024,
+				ACCESSOR_NO_SETTER = 1<<0, // no __set@name, __get@name or __set
+				ACCESSOR_NO_GETTER = 1<<1  // no __get@name
+			};
+			struct AccessorCacheEntry
+			{
+				int proto_id;
+				int name_id;
+				int epoch;
+				int flags;
+			};
+			AccessorCacheEntry accessor_cache[ACCESSOR_CACHE_SIZE];
+			int accessor_epoch;
+
+			static bool isAccessorName(const Value& index);
+			bool isAccessorFree(GCValue * table_value, GCStringValue * name, int flag, bool prototype_enabled);
+			void setAccessorFree(GCValue * table_value, GCStringValue * name, int flag);
+			void prototypeChanged(GCValue * changed_value);
+
+			int table_version_seq;
+			int property_cache_epoch; // changes when a watched prototype table changes
+
+			void tableChanged(Table * table);
+
+			Shape ** shapes; // by parent and key
+			int shapes_head_mask;
+			int shapes_count;
+
+			Shape * getShapeTransition(Shape * parent, const Value& index);
+			void unshapeTable(Table * table);
+			void growTableBlock(Table * table, int new_size);
+			void resizeTableHeads(Table * table, int new_size);
+			void insertTableHead(Table * table, Property * prop);
+			void removeTableHead(Table * table, Property * prop);
+			void deleteShapes();
+			bool getCachedPropertyValue(Value& result, const Value& obj, const Value& index, Program * prog, int opcode_pos);
 			
 			int gc_start_when_used_bytes;
 			int gc_next_when_used_bytes;
+			int gc_pause; // percent of the used bytes left by a full cycle, reached before the next one
 			int gc_step_type;
+			double gc_total_time; // seconds spent in full cycles
+			double gc_last_pause;
+			double gc_max_pause;
 			bool gc_in_progress;
 			bool gc_fix_in_progress;
 
@@ -2659,6 +2810,15 @@ namespace ObjectScript
 			void dumpValues(Buffer& out);
 			void dumpValuesToFile(const OS_CHAR * filename);
 			void appendQuotedString(Buffer& buf, const String& string);
+			// same text as valueToString(val, true), without a temporary string
+			void appendValueString(Buffer& buf, const Value& val);
+			// values of an array or object separated by separator, like Array.join
+			void appendJoined(Buffer& buf, const Value& list, const String& separator);
+			void appendJsonString(Buffer& buf, const OS_CHAR * str, int len);
+			// custom_enabled: ask val's own toJson method if it differs from Object.toJson
+			void appendJson(Buffer& buf, const Value& val, bool custom_enabled);
+			// pushes the value of the JSON text, or sets an exception and returns false
+			bool pushJsonValue(const OS_CHAR * str, int len);
 
 			struct {
 				bool create_text_opcodes;
@@ -2667,6 +2827,7 @@ namespace ObjectScript
 				bool create_compiled_file;
 				bool primary_compiled_file;
 				bool sourcecode_must_exist;
+				bool compile_debug_calls;
 			} settings;
 
 			enum {
@@ -2683,6 +2844,29 @@ namespace ObjectScript
 			int terminated_code;
 			Value terminated_exception;
 
+			volatile bool sample_requested; // set asynchronously, handled at the loop head or by the next jump
+			OS_SampleCallback sample_callback;
+			void * sample_user_param;
+
+			OS_INT64 * opcode_counters; // indexed by opcode, NULL unless counting
+			OS_NativeCallCallback native_call_callback;
+			void * native_call_user_param;
+			int gc_cycles; // full collections so far
+
+			Coroutine * running_coroutine;
+			Coroutine * coroutines; // NEW and SUSPENDED ones
+			int yield_call_pos; // start of the native call made by OP_CALL, -1 otherwise
+			int execute_ret_stack_funcs; // ret_stack_funcs of the innermost execute(), -1 outside
+			bool yield_requested;
+			int yield_slot_pos;
+			Value yield_value;
+
+			void linkCoroutine(Coroutine*);
+			void unlinkCoroutine(Coroutine*);
+			void suspendCoroutine();
+			void restoreCoroutine(Coroutine*, const Value& resume_value);
+			void clearCoroutine(Coroutine*);
+
 			int getRandSeed();
 			void setRandSeed(int seed);
 			void randReload();
@@ -2987,6 +3171,7 @@ namespace ObjectScript
 			void pushRestArguments(StackFunction*);
 
 			void execute();
+			void execute(int ret_stack_funcs);
 			void reloadStackFunctionCache();
 
 			void callFT(int start_pos, int call_params, int ret_values, GCValue * self_for_proto, OS_ECallEnter call_enter, OS_ECallType call_type, OS_ECallThisUsage call_this_usage);
@@ -3009,6 +3194,7 @@ namespace ObjectScript
 		MemoryManager * memory_manager;
 		Core * core;
 		int ref_count;
+		OS_INT64 total_allocated_bytes;
 
 #ifdef OS_DEBUG
 		int native_stack_start_mark;
@@ -3038,6 +3224,7 @@ namespace ObjectScript
 		void initMathModule();
 		void initJsonModule();
 		void initGCModule();
+		void initCoroutineModule();
 		void initLangTokenizerModule();
 		virtual void initSettings();
 		virtual void initPreScript();
@@ -3204,6 +3391,41 @@ namespace ObjectScript
 
 		void pushBackTrace(int skip_funcs, int max_trace_funcs = 20);
 
+		struct CallStackFrame
+		{
+			const OS_CHAR * name;
+			const OS_CHAR * file;
+			int line; // 0 if unknown
+		};
+
+		// Fills frames starting with the innermost script function and returns
+		// their number. The strings are valid while the frames are running.
+		int getCallStackFrames(CallStackFrame * frames, int max_frames);
+
+		// The callback runs before the next opcode once a sample was requested.
+		// requestSample() only sets a flag, it may be called from a signal
+		// handler or another thread.
+		void setSampleCallback(OS_SampleCallback callback, void * user_param = NULL);
+		void requestSample();
+
+		// While counters are set, every executed opcode increments
+		// counters[opcode]. The array holds getOpcodeCount() items.
+		void setOpcodeCounters(OS_INT64 * counters);
+		static int getOpcodeCount();
+		static const OS_CHAR * getOpcodeName(int opcode);
+
+		// Seconds on a monotonic clock, the GC times its pauses with it.
+		static double getTimeSec();
+
+		// The callback runs right before (enter is true) and after every call
+		// of a C function.
+		void setNativeCallCallback(OS_NativeCallCallback callback, void * user_param = NULL);
+		// Returns false if the value is not a C function.
+		bool getCFunction(int offs, OS_CFunction * func, void ** func_user_param);
+
+		int getGCCycles();
+		OS_INT64 getTotalAllocatedBytes();
+
 		void pushStackValue(int offs = -1);
 		void pushGlobals();
 		void pushUserPool();
@@ -3284,6 +3506,9 @@ namespace ObjectScript
 		String		popString(const String& def, bool valueof_enabled = true);
 		String		popString(const OS_CHAR * def, bool valueof_enabled = true);
 
+		// str as a JSON string literal, quotes included, escaped the way json.encode does
+		String encodeJsonString(const OS_CHAR * str, int len);
+
 		int getSetting(OS_ESettings);
 		int setSetting(OS_ESettings, int);
 
@@ -3321,6 +3546,8 @@ namespace ObjectScript
 
 		void setGCStartWhenUsedBytes(int);
 		int getGCStartWhenUsedBytes();
+		void setGCPause(int percent);
+		int getGCPause();
 
 		struct FuncDef {
 			const OS_CHAR * name;
@@ -3401,6 +3628,8 @@ namespace ObjectScript
 		String resolvePath(const String& filename);
 		virtual String resolvePath(const String& filename, const String& cur_path);
 		virtual String getCompiledFilename(const String& resolved_filename);
+		// the same source compiles differently as a template, the default ignores source_code_type
+		virtual String getCompiledFilename(const String& resolved_filename, OS_ESourceCodeType source_code_type);
 		virtual String getTextOpcodesFilename(const String& resolved_filename);
 
 		virtual OS_EFileUseType checkFileUsage(const String& sourcecode_filename, const String& compiled_filename);
@@ -0,0 +1,233 @@
+/**
+    @file
+    @brief Machine-readable build event stream
+
+    With --log-format=jsonl, IceTea writes one JSON object per line for every
+    phase transition, task start and finish, cache hit and configure check.
+    The stream goes to stderr, or to the file given by --log-file. A value of
+    the form fd:N writes to an already open file descriptor instead.
+
+    Every event carries "event" (its type) and "time", the seconds since the
+    stream was opened. Lines are written in one go, so a reader never sees a
+    partial event.
+*/
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "IceTea.h"
+#include "os-icetea.h"
+#include "predef.h"
+#include "InternalIceTeaPlugin.h"
+
+#if defined(PREDEF_PLATFORM_WIN32)
+#   include <io.h>
+#   define ICETEA_FDOPEN _fdopen
+#else
+#   define ICETEA_FDOPEN fdopen
+#endif
+
+using namespace std;
+using namespace ObjectScript;
+
+// One event, assembled field by field.
+class Event {
+    OS* os;
+    stringstream ss;
+public:
+    Event(OS* vm, const string& type, double time) : os(vm) {
+        ss << "{\"event\":" << icetea_json_quote(os, type) << ",\"time\":" << time;
+    }
+
+    Event& add(const char* key, const string& val) {
+        ss << ",\"" << key << "\":" << icetea_json_quote(os, val);
+        return *this;
+    }
+    Event& add(const char* key, double val) {
+        ss << ",\"" << key << "\":" << val;
+        return *this;
+    }
+    Event& add(const char* key, bool val) {
+        ss << ",\"" << key << "\":" << (val ? "true" : "false");
+        return *this;
+    }
+
+    string str() {
+        return ss.str() + "}\n";
+    }
+};
+
+class EventLog {
+    FILE* fh;
+    bool owned;
+    double opened;
+    map<string, double> started;
+
+public:
+    EventLog() : fh(NULL), owned(false), opened(0) {}
+    ~EventLog() { close(); }
+
+    // Open the stream. Returns false if the destination can not be used.
+    bool open(const string& dest) {
+        opened = OS::getTimeSec();
+        if(dest.empty()) {
+            fh = stderr;
+        } else if(dest.compare(0, 3, "fd:") == 0) {
+            fh = ICETEA_FDOPEN(atoi(dest.c_str() + 3), "w");
+            owned = true;
+        } else {
+            fh = fopen(dest.c_str(), "w");
+            owned = true;
+        }
+        return fh != NULL;
+    }
+
+    void close() {
+        if(fh != NULL && owned) fclose(fh);
+        fh = NULL;
+    }
+
+    bool enabled() { return fh != NULL; }
+
+    // Seconds since the stream was opened.
+    double elapsed() {
+        return OS::getTimeSec() - opened;
+    }
+
+    void write(Event& ev) {
+        if(fh == NULL) return;
+        string line = ev.str();
+        fwrite(line.c_str(), 1, line.length(), fh);
+        fflush(fh);
+    }
+
+    void begin(const string& key) {
+        started[key] = OS::getTimeSec();
+    }
+
+    // Seconds since begin() was called for this key, or -1.
+    double end(const string& key) {
+        map<string, double>::iterator it = started.find(key);
+        if(it == started.end()) return -1;
+        double took = OS::getTimeSec() - it->second;
+        started.erase(it);
+        return took;
+    }
+};
+
+static EventLog eventLog;
+
+// Optional arguments: Only set them when they were given and not null.
+#define HAS_ARG(n) (params > (n) && !os->isNull(-params+(n)))
+
+OS_FUNC(events_enabled) {
+    os->pushBool(eventLog.enabled());
+    return 1;
+}
+
+OS_FUNC(events_phase) {
+    // events.phase(name)
+    if(!eventLog.enabled()) return 0;
+    Event ev(os, "phase", eventLog.elapsed());
+    ev.add("phase", string(os->toString(-params+0).toChar()));
+    eventLog.write(ev);
+    return 0;
+}
+
+OS_FUNC(events_taskStart) {
+    // events.taskStart(output, target, step)
+    if(!eventLog.enabled()) return 0;
+    string out = os->toString(-params+0).toChar();
+    eventLog.begin(out);
+    Event ev(os, "task_start", eventLog.elapsed());
+    ev.add("output", out)
+      .add("target", string(os->toString(-params+1).toChar()))
+      .add("step", string(os->toString(-params+2).toChar()));
+    eventLog.write(ev);
+    return 0;
+}
+
+OS_FUNC(events_taskFinish) {
+    // events.taskFinish(output, ok, exitCode, outputSize)
+    if(!eventLog.enabled()) return 0;
+    string out = os->toString(-params+0).toChar();
+    Event ev(os, "task_finish", eventLog.elapsed());
+    ev.add("output", out).add("ok", os->toBool(-params+1));
+    double took = eventLog.end(out);
+    if(took >= 0)   ev.add("duration", took);
+    if(HAS_ARG(2))  ev.add("exit_code", (double)os->toInt(-params+2));
+    if(HAS_ARG(3))  ev.add("output_size", (double)os->toInt(-params+3));
+    eventLog.write(ev);
+    return 0;
+}
+
+OS_FUNC(events_cacheHit) {
+    // events.cacheHit(output, target, step)
+    if(!eventLog.enabled()) return 0;
+    Event ev(os, "cache_hit", eventLog.elapsed());
+    ev.add("output", string(os->toString(-params+0).toChar()))
+      .add("target", string(os->toString(-params+1).toChar()))
+      .add("step", string(os->toString(-params+2).toChar()));
+    eventLog.write(ev);
+    return 0;
+}
+
+OS_FUNC(events_check) {
+    // events.check(subject, ok, result, cached)
+    if(!eventLog.enabled()) return 0;
+    Event ev(os, "check", eventLog.elapsed());
+    ev.add("check", string(os->toString(-params+0).toChar()))
+      .add("ok", os->toBool(-params+1))
+      .add("result", string(os->toString(-params+2).toChar()))
+      .add("cached", HAS_ARG(3) && os->toBool(-params+3));
+    eventLog.write(ev);
+    return 0;
+}
+
+class IceTeaEvents: public IceTeaPlugin {
+public:
+    bool configure(IceTea* os) {
+        CLI* cli = os->getCliHandle();
+        if(cli->check("--log-format")) {
+            string format = cli->value("--log-format");
+            if(format != "jsonl") {
+                cerr << "Unknown log format: " << format << " (Supported: jsonl)" << endl;
+                return false;
+            }
+            string dest = cli->check("--log-file") ? cli->value("--log-file") : "";
+            if(!eventLog.open(dest)) {
+                cerr << "Can not open event log: " << dest << endl;
+                return false;
+            }
+        }
+
+        OS::FuncDef eventFuncs[] = {
+            {OS_TEXT("__get@enabled"),  events_enabled},
+            {OS_TEXT("phase"),          events_phase},
+            {OS_TEXT("taskStart"),      events_taskStart},
+            {OS_TEXT("taskFinish"),     events_taskFinish},
+            {OS_TEXT("cacheHit"),       events_cacheHit},
+            {OS_TEXT("check"),          events_check},
+            {}
+        };
+        os->getModule("events");
+        os->setFuncs(eventFuncs);
+        os->pop();
+
+        return true;
+    }
+    string getName() {
+        return "Events";
+    }
+    string getDescription() {
+        return  "Writes a newline-delimited JSON event stream of the build.\n"
+                "- Phases, task start and finish, cache hits and configure checks\n"
+                "- Enable with --log-format=jsonl, redirect with --log-file";
+    }
+};
+ICETEA_INTERNAL_MODULE(IceTeaEvents);
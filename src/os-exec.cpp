@@ -77,8 +77,9 @@ string SyncProcess::getStderr() { return stderr; }
 bool AsyncProcess::callback() {
     int outRead = this->read_stdout(this->stdout);
     int errRead = this->read_stderr(this->stderr);
-    if(outRead != -1 && errRead != -1) {
-        // Eat the output streams first.
+    if(outRead != -1 || errRead != -1) {
+        // Eat the output streams first. A stream at its end does not stop
+        // reading the other one.
         return true;
     } else if(error()) {
         // THEN check for errors.
@@ -87,6 +88,16 @@ bool AsyncProcess::callback() {
         return false;
     }
 }
+bool AsyncProcess::tick() {
+    if(async_subprocess::tick()) {
+        return true;
+    }
+    // The child may have written more after the last callback() and
+    // before it exited. Read what is left, so stdout() is complete.
+    while(this->read_stdout(this->stdout) > 0) {}
+    while(this->read_stderr(this->stderr) > 0) {}
+    return false;
+}
 string AsyncProcess::getStdout() { return stdout; }
 string AsyncProcess::getStderr() { return stderr; }
 
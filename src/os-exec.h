@@ -34,6 +34,7 @@ public:
     std::string getStdout();
     std::string getStderr();
     bool callback();
+    bool tick();
 };
 
 #endif
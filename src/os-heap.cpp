@@ -7,6 +7,8 @@
 #endif
 #include <string.h>
 
+#include "tinythread.h"
+
 using namespace ObjectScript;
 
 // #define OS_ASSERT OS_ASSERT
@@ -1272,7 +1274,12 @@ void OSHeapManager::dumpUsage(OS * os, const OS_CHAR * filename)
 	if(!f){
 		return;
 	}
-	OS_U32 free_size = 0x7fffffff;
+	writeUsage(os, f);
+	os->closeFile(f);
+}
+
+void OSHeapManager::writeUsage(OS * os, OS::FileHandle * f)
+{
 	writeStats(os, f);
 
 #ifndef OS_USE_HEAP_SAVING_MODE
@@ -1292,8 +1299,6 @@ void OSHeapManager::dumpUsage(OS * os, const OS_CHAR * filename)
 
 	writeBlockHeader(os, f, 2);
 	writeBlocks(os, f, &dummy_large_block);
-
-	os->closeFile(f);
 }
 
 void OSHeapManager::getStats(Stats& small_stats, Stats& medium_stats, Stats& large_stats)
@@ -1391,3 +1396,222 @@ void OSHeapManager::getStats(SummaryStats& stats)
 
 #endif // OS_USE_HEAP_SAVING_MODE
 }
+
+// =====================================================================
+// =====================================================================
+// =====================================================================
+
+struct OSThreadHeapManager::Arena
+{
+	OSHeapManager * heap;
+	tthread::thread::id owner;
+
+	// Blocks freed by other threads, linked through their header words
+	void * volatile remote;
+	OS_U32 drain_count;
+
+	Arena * next;
+};
+
+#define THREAD_HEAP_HEADER_SIZE OS_HEAP_SIZE_ALIGN(sizeof(void*))
+#define THREAD_HEAP_MUTEX ((tthread::mutex*)mutex)
+
+// Arena of the current thread for the manager with serial thread_heap_serial.
+// Serials are never reused, so a manager at the address of a released one
+// doesn't pick up a stale arena.
+static thread_local int thread_heap_serial;
+static thread_local void * thread_heap_arena;
+static int thread_heap_next_serial;
+
+OSThreadHeapManager::OSThreadHeapManager(bool p_bulk)
+{
+	arenas = NULL;
+	mutex = new tthread::mutex();
+	serial = OS_ATOMIC_ADD(&thread_heap_next_serial, 1);
+	bulk = p_bulk;
+	OS_MEMSET(&stats, 0, sizeof(stats));
+}
+
+OSThreadHeapManager::~OSThreadHeapManager()
+{
+	// No interpreter uses the manager anymore, so every arena can go at once:
+	// OSHeapManager frees its pages in bulk.
+	while(arenas){
+		Arena * arena = arenas;
+		arenas = arena->next;
+		if(!bulk){
+			drain(arena);
+		}
+		arena->heap->release();
+		delete arena;
+	}
+	delete THREAD_HEAP_MUTEX;
+}
+
+OSThreadHeapManager::Arena * OSThreadHeapManager::getArena()
+{
+	if(thread_heap_serial == serial){
+		return (Arena*)thread_heap_arena;
+	}
+	Arena * arena = findArena();
+	thread_heap_serial = serial;
+	thread_heap_arena = arena;
+	return arena;
+}
+
+OSThreadHeapManager::Arena * OSThreadHeapManager::findArena()
+{
+	tthread::lock_guard<tthread::mutex> guard(*THREAD_HEAP_MUTEX);
+	stats.lookup_count++;
+
+	// A thread with the id of a finished one takes over its arena
+	tthread::thread::id id = tthread::this_thread::get_id();
+	for(Arena * arena = arenas; arena; arena = arena->next){
+		if(arena->owner == id){
+			return arena;
+		}
+	}
+	Arena * arena = new Arena();
+	arena->heap = new OSHeapManager();
+	arena->owner = id;
+	arena->remote = NULL;
+	arena->drain_count = 0;
+	arena->next = arenas;
+	arenas = arena;
+	stats.arena_count++;
+	return arena;
+}
+
+void OSThreadHeapManager::drain(Arena * arena)
+{
+	void * block = OS_ATOMIC_XCHG_PTR(&arena->remote, (void*)NULL);
+	while(block){
+		void * next = *(void**)block;
+		arena->heap->free(block);
+		block = next;
+	}
+	arena->drain_count++;
+}
+
+void * OSThreadHeapManager::malloc(int size OS_DBG_FILEPOS_DECL)
+{
+	if(size <= 0){
+		return NULL;
+	}
+	Arena * arena = getArena();
+	if(OS_ATOMIC_LOAD_PTR(&arena->remote)){
+		drain(arena);
+	}
+	void ** block = (void**)arena->heap->malloc(size + THREAD_HEAP_HEADER_SIZE OS_DBG_FILEPOS_PARAM);
+	if(!block){
+		return NULL;
+	}
+	*block = arena;
+	return (OS_BYTE*)block + THREAD_HEAP_HEADER_SIZE;
+}
+
+void OSThreadHeapManager::free(void * p)
+{
+	if(!p || bulk){
+		return;
+	}
+	void ** block = (void**)((OS_BYTE*)p - THREAD_HEAP_HEADER_SIZE);
+	Arena * arena = (Arena*)*block;
+	if(thread_heap_serial == serial && thread_heap_arena == arena){
+		arena->heap->free(block);
+		return;
+	}
+	// The header word isn't needed anymore, it links the remote list now
+	void * head = OS_ATOMIC_LOAD_PTR(&arena->remote);
+	for(;;){
+		*block = head;
+		if(OS_ATOMIC_CAS_PTR(&arena->remote, head, (void*)block)){
+			break;
+		}
+		OS_ATOMIC_ADD(&stats.retry_count, 1);
+		head = OS_ATOMIC_LOAD_PTR(&arena->remote);
+	}
+	OS_ATOMIC_ADD(&stats.remote_free_count, 1);
+}
+
+void OSThreadHeapManager::setBreakpointId(int id)
+{
+}
+
+int OSThreadHeapManager::getAllocatedBytes()
+{
+	return getArena()->heap->getAllocatedBytes();
+}
+
+int OSThreadHeapManager::getMaxAllocatedBytes()
+{
+	OS_ASSERT(false);
+	return 0;
+}
+
+int OSThreadHeapManager::getUsedBytes()
+{
+	return getArena()->heap->getUsedBytes();
+}
+
+int OSThreadHeapManager::getCachedBytes()
+{
+	return getAllocatedBytes() - getUsedBytes();
+}
+
+bool OSThreadHeapManager::isBulk() const
+{
+	return bulk;
+}
+
+void OSThreadHeapManager::dumpUsage(OS * os, const OS_CHAR * filename)
+{
+	OS::FileHandle * f = os->openFile(filename, "wt");
+	if(!f){
+		return;
+	}
+	char buf[256];
+	ContentionStats contention;
+	getContentionStats(contention);
+	OS_SNPRINTF(buf, sizeof(buf)-1, "ARENAS:\t%d\tlookups\t%d\tremote frees\t%d\tretries\t%d\tdrains\t%d\tbulk\t%d\n\n",
+		contention.arena_count, contention.lookup_count, contention.remote_free_count,
+		contention.retry_count, contention.drain_count, (int)bulk);
+	os->writeFile(buf, (int)OS_STRLEN(buf), f);
+
+	tthread::lock_guard<tthread::mutex> guard(*THREAD_HEAP_MUTEX);
+	int i = 0;
+	for(Arena * arena = arenas; arena; arena = arena->next){
+		OS_SNPRINTF(buf, sizeof(buf)-1, "ARENA %d\n", ++i);
+		os->writeFile(buf, (int)OS_STRLEN(buf), f);
+		arena->heap->writeUsage(os, f);
+		os->writeFile("\n", 1, f);
+	}
+	os->closeFile(f);
+}
+
+void OSThreadHeapManager::getStats(OSHeapManager::SummaryStats& stats)
+{
+	OS_MEMSET(&stats, 0, sizeof(stats));
+	tthread::lock_guard<tthread::mutex> guard(*THREAD_HEAP_MUTEX);
+	for(Arena * arena = arenas; arena; arena = arena->next){
+		OSHeapManager::SummaryStats cur;
+		arena->heap->getStats(cur);
+		stats.alloc_count += cur.alloc_count;
+		stats.alloc_size += cur.alloc_size;
+		stats.used_size += cur.used_size;
+		stats.data_size += cur.data_size;
+		stats.free_count += cur.free_count;
+		stats.hit_count += cur.hit_count;
+		stats.merge_count += cur.merge_count;
+	}
+}
+
+void OSThreadHeapManager::getContentionStats(ContentionStats& stats)
+{
+	tthread::lock_guard<tthread::mutex> guard(*THREAD_HEAP_MUTEX);
+	stats = this->stats;
+	stats.drain_count = 0;
+	for(Arena * arena = arenas; arena; arena = arena->next){
+		stats.drain_count += arena->drain_count;
+	}
+}
@@ -113,10 +113,25 @@ namespace ObjectScript {
 #define OS_DUMMY_ID_SIZE 0
 #endif
 
+#if defined _MSC_VER && !defined IW_SDK
+#include <intrin.h>
+#define OS_ATOMIC_ADD(p, n) (_InterlockedExchangeAdd((volatile long*)(p), (long)(n)) + (n))
+#define OS_ATOMIC_CAS_PTR(p, old_val, new_val) (_InterlockedCompareExchangePointer((void * volatile *)(p), (new_val), (old_val)) == (old_val))
+#define OS_ATOMIC_XCHG_PTR(p, val) _InterlockedExchangePointer((void * volatile *)(p), (val))
+#define OS_ATOMIC_LOAD_PTR(p) _InterlockedCompareExchangePointer((void * volatile *)(p), NULL, NULL)
+#else
+#define OS_ATOMIC_ADD(p, n) __sync_add_and_fetch((p), (n))
+#define OS_ATOMIC_CAS_PTR(p, old_val, new_val) __sync_bool_compare_and_swap((p), (old_val), (new_val))
+#define OS_ATOMIC_XCHG_PTR(p, val) __sync_lock_test_and_set((p), (val))
+#define OS_ATOMIC_LOAD_PTR(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#endif
+
 class OSHeapManager: public OS::MemoryManager
 {
 protected:
 
+	friend class OSThreadHeapManager;
+
 	class SimpleStats
 	{
 	public:
@@ -303,6 +318,7 @@ protected:
 	void writeFile(OS * os, OS::FileHandle * f, const char * buf);
 
 	void writeStats(OS * os, OS::FileHandle * f);
+	void writeUsage(OS * os, OS::FileHandle * f);
 
 #ifdef OS_DEBUG
 	void writeSmallBlockHeader(OS * os, OS::FileHandle * f);
@@ -367,6 +383,72 @@ public:
 	void checkMemory();
 };
 
+/**
+* Memory manager that interpreters on several threads can share. Every
+* thread allocates from an arena of its own, a plain OSHeapManager, without
+* locking. A block remembers its arena in a header word: a thread freeing a
+* block of another arena pushes it onto that arena's remote list with a
+* compare-and-swap, and the owner frees the list on its next allocation.
+*
+* In bulk mode free() does nothing and all memory goes back at once when the
+* manager is released, for short-lived interpreters: create one on the
+* manager, release the manager, run it and release it. Memory the garbage
+* collector frees is not reused then, so keep such interpreters small.
+*/
+class OSThreadHeapManager: public OS::MemoryManager
+{
+public:
+
+	struct ContentionStats
+	{
+		OS_U32 arena_count;			// one per thread that allocated
+		OS_U32 lookup_count;		// arena lookups that had to take the lock
+		OS_U32 remote_free_count;	// blocks freed by another thread than their arena's
+		OS_U32 retry_count;			// remote frees that raced another one and retried
+		OS_U32 drain_count;			// remote lists freed by their arena's thread
+	};
+
+protected:
+
+	struct Arena;
+
+	Arena * arenas;
+	void * mutex; // tthread::mutex, see os-heap.cpp
+	int serial;
+	bool bulk;
+	ContentionStats stats;
+
+	Arena * getArena();
+	Arena * findArena();
+	void drain(Arena * arena);
+
+	virtual ~OSThreadHeapManager();
+
+public:
+
+	OSThreadHeapManager(bool bulk = false);
+
+	virtual void * malloc(int size OS_DBG_FILEPOS_DECL);
+	virtual void free(void * p);
+
+	virtual void setBreakpointId(int id);
+
+	// Bytes of the calling thread's arena, which drive its interpreter's GC.
+	// getStats() sums all arenas.
+	virtual int getAllocatedBytes();
+	virtual int getMaxAllocatedBytes();
+	virtual int getUsedBytes();
+	virtual int getCachedBytes();
+
+	bool isBulk() const;
+
+	// Over all arenas, exact only while the other threads don't allocate
+	void dumpUsage(OS * os, const OS_CHAR * filename);
+
+	void getStats(OSHeapManager::SummaryStats& stats);
+	void getContentionStats(ContentionStats& stats);
+};
+
 }; // namespace ObjectScript
 
 #endif // __OS_HEAP_MANAGER_H__
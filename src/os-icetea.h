@@ -6,4 +6,9 @@
 // Debate: rename "os" to "it"?
 #define OS_FUNC(name) int name(ObjectScript::OS* os, int params, int closure_values, int need_ret_values, void* userData)
 
+// A JSON string literal for str, quotes included.
+inline std::string icetea_json_quote(ObjectScript::OS* os, const std::string& str) {
+    return os->encodeJsonString(str.c_str(), (int)str.length()).toChar();
+}
+
 #endif
@@ -0,0 +1,255 @@
+/**
+    @file
+    @brief Scripted tasks on isolated interpreters
+
+    A step or rule with isolated: "<file>" does not run its scheme functions on
+    the main interpreter. The task is sent to a pool of worker threads instead,
+    each with an interpreter of its own that has only the PFS, System,
+    SubProcess and Process plugins plus std.os.
+
+    A worker requires <file> once. The file returns an object with one function
+    per scheme, like build and clean. It is called with this set to a copy of
+    the task: {in, out, target, scheme}. Both the task and the returned value
+    travel as JSON, so only plain data crosses threads - no closures, targets
+    or other objects of the main interpreter.
+
+    The pool is as wide as -j and starts with the first isolated task.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdlib.h>
+
+#include "IceTea.h"
+#include "os-icetea.h"
+#include "threading.h"
+#include "InternalIceTeaPlugin.h"
+
+using namespace std;
+using namespace ObjectScript;
+
+struct IsolatedJob {
+    string file;
+    string scheme;
+    string task;    ///< JSON of the task
+    // Set by the worker.
+    bool done;
+    bool failed;
+    string result;  ///< JSON of the return value, or the error message
+
+    IsolatedJob() : done(false), failed(false) {}
+};
+
+typedef WorkQueue<IsolatedJob*> IsolatedQueue;
+
+// Replace the value on top of the stack with json.<func>(value).
+static bool isolated_json(OS* os, const OS_CHAR* func) {
+    os->getModule("json");
+    os->getProperty(-1, func);
+    os->pushStackValue(-2);
+    os->pushStackValue(-4);
+    os->callFT(1, 1);
+    os->remove(-3, 2);
+    return !os->isExceptionSet();
+}
+
+// Pop the pending exception as a message.
+static string isolated_error(OS* os) {
+    os->getException();
+    os->resetException();
+    if(os->isObject()) {
+        // Thrown strings end up in an Exception object.
+        os->pushString("message");
+        bool hasMessage = os->in(-1, -2);
+        os->pop();
+        if(hasMessage) {
+            os->getProperty(-1, "message");
+            os->remove(-2);
+        }
+    }
+    string msg = os->popString().toChar();
+    return msg.empty() ? "unknown error" : msg;
+}
+
+static void isolated_run(IceTea* os, map<string, int>& modules, IsolatedJob* job) {
+    int top = os->getStackSize();
+    map<string, int>::iterator it = modules.find(job->file);
+    if(it == modules.end()) {
+        os->OS::require(job->file.c_str(), true, 1, OS_SOURCECODE_AUTO, true, false);
+        if(os->isExceptionSet()) {
+            job->failed = true;
+            job->result = isolated_error(os);
+            os->pop(os->getStackSize() - top);
+            return;
+        }
+        int id = os->getValueId();
+        os->retainValueById(id);
+        it = modules.insert(make_pair(job->file, id)).first;
+        os->pop();
+    }
+
+    os->pushValueById(it->second);
+    os->getProperty(-1, job->scheme.c_str());
+    if(!os->isFunction()) {
+        os->pop(2);
+        job->failed = true;
+        job->result = job->file + " has no " + job->scheme + " function.";
+        return;
+    }
+    os->pushString(job->task.c_str());
+    if(isolated_json(os, OS_TEXT("decode"))) {
+        os->callFT(0, 1);
+    }
+    if(!os->isExceptionSet()) {
+        isolated_json(os, OS_TEXT("encode"));
+    }
+    if(os->isExceptionSet()) {
+        job->failed = true;
+        job->result = isolated_error(os);
+    } else {
+        job->result = os->toString().toChar();
+    }
+    os->pop(os->getStackSize() - top);
+}
+
+static void isolated_worker(void* arg) {
+    IsolatedQueue* queue = (IsolatedQueue*)arg;
+
+    vector<string> names;
+    names.push_back("PFS: FileSystem+");
+    names.push_back("System");
+    names.push_back("SubProcess");
+    names.push_back("Process");
+    names.push_back("Standard Library Extension");
+    IceTea* os = IceTea::create();
+    bool ready = os->startupWorker(names);
+
+    // Required files by name, retained for the life of the worker.
+    map<string, int> modules;
+    IsolatedJob* job;
+    while(queue->take(job)) {
+        if(ready) {
+            isolated_run(os, modules, job);
+        } else {
+            job->failed = true;
+            job->result = "The worker interpreter could not start.";
+        }
+        tthread::lock_guard<tthread::mutex> guard(queue->mutex);
+        job->done = true;
+    }
+    os->release();
+}
+
+// Workers wait for jobs until the process exits. Like the main interpreter,
+// the pool is never torn down: static destructors of tinythread may already
+// have run by then.
+
+class IsolatedPool {
+    IsolatedQueue* queue;
+    map<int, IsolatedJob*> jobs;
+    int lastId;
+public:
+    int width;
+
+    IsolatedPool() : queue(NULL), lastId(0), width(1) {}
+
+    int add(IsolatedJob* job) {
+        if(queue == NULL) {
+            queue = new IsolatedQueue(width, isolated_worker);
+        }
+        jobs[++lastId] = job;
+        queue->add(job);
+        return lastId;
+    }
+
+    // NULL for unknown ids.
+    IsolatedJob* get(int id) {
+        map<int, IsolatedJob*>::iterator it = jobs.find(id);
+        return it == jobs.end() ? NULL : it->second;
+    }
+
+    bool isDone(IsolatedJob* job) {
+        tthread::lock_guard<tthread::mutex> guard(queue->mutex);
+        return job->done;
+    }
+
+    void remove(int id) {
+        delete jobs[id];
+        jobs.erase(id);
+    }
+};
+static IsolatedPool& isolated_pool = *new IsolatedPool();
+
+OS_FUNC(isolated_start) {
+    // isolated.run(file, scheme, task) -> job
+    if(params < 3 || !os->isString(-params+0) || !os->isString(-params+1)) {
+        os->setException("isolated.run expects a file, a scheme and a task.");
+        return 0;
+    }
+    IsolatedJob* job = new IsolatedJob();
+    job->file = os->toString(-params+0).toChar();
+    job->scheme = os->toString(-params+1).toChar();
+    os->pushStackValue(-params+2);
+    if(!isolated_json(os, OS_TEXT("encode"))) {
+        delete job;
+        return 0;
+    }
+    job->task = os->popString().toChar();
+    os->pushNumber(isolated_pool.add(job));
+    return 1;
+}
+
+OS_FUNC(isolated_tick) {
+    // isolated.tick(job) -> true while it runs
+    IsolatedJob* job = isolated_pool.get((int)os->toNumber(-params+0));
+    os->pushBool(job != NULL && !isolated_pool.isDone(job));
+    return 1;
+}
+
+OS_FUNC(isolated_result) {
+    // isolated.result(job) -> the returned value. Throws the worker's error.
+    int id = (int)os->toNumber(-params+0);
+    IsolatedJob* job = isolated_pool.get(id);
+    if(job == NULL || !isolated_pool.isDone(job)) {
+        os->setException("isolated.result: the job is unknown or still running.");
+        return 0;
+    }
+    bool failed = job->failed;
+    os->pushString(job->result.c_str());
+    isolated_pool.remove(id);
+    if(failed) {
+        os->setException(os->popString());
+        return 0;
+    }
+    return isolated_json(os, OS_TEXT("decode")) ? 1 : 0;
+}
+
+class IceTeaIsolated: public IceTeaPlugin {
+public:
+    bool configure(IceTea* os) {
+        int width = os->getCliHandle() ? atoi(os->getCliHandle()->value("-j").c_str()) : 0;
+        isolated_pool.width = width > 0 ? width : 1;
+
+        OS::FuncDef isolatedFuncs[] = {
+            {OS_TEXT("run"),    isolated_start},
+            {OS_TEXT("tick"),   isolated_tick},
+            {OS_TEXT("result"), isolated_result},
+            {}
+        };
+        os->getModule("isolated");
+        os->setFuncs(isolatedFuncs);
+        os->pop();
+        return true;
+    }
+    string getName() {
+        return "Isolated";
+    }
+    string getDescription() {
+        return  "Runs the tasks of isolated steps and rules on worker threads.\n"
+                "- isolated.run(file, scheme, task) queues a task, returns a job\n"
+                "- isolated.tick(job) is true while it runs\n"
+                "- isolated.result(job) returns its value or throws its error";
+    }
+};
+ICETEA_INTERNAL_MODULE(IceTeaIsolated);
@@ -1,9 +1,15 @@
 #include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
 #include "IceTea.h"
 #include "os-pfs.h"
+#include "os-slre.h"
 #include "file_system.hpp"
 #include "wildcard.hpp"
+#include "threading.h"
 #include "InternalIceTeaPlugin.h"
 
 #if defined(PREDEF_PLATFORM_WIN32)
@@ -234,6 +240,196 @@ OS_FUNC(os_pfs_join) {
     return 1;
 }
 
+// pfs.scan searches the files on the calling thread and a pool of -j - 1 more,
+// each with a buffer and a regex scratch of its own. Threads take the next file
+// of a batch until none is left. Only the matches reach the interpreter.
+struct ScanJob {
+    string file;
+    vector<strVec> matches;     ///< The match, then its groups
+    bool tooLarge;              ///< Offsets into it would not fit an int
+
+    ScanJob() : tooLarge(false) {}
+};
+
+struct ScanBatch {
+    const Regexp* re;
+    vector<ScanJob> jobs;
+    size_t next;
+    int helpers;                ///< Pool threads still working on it
+    tthread::mutex mutex;
+    tthread::condition_variable cond;
+};
+
+typedef WorkQueue<ScanBatch*> ScanQueue;
+static ScanQueue* pfs_scan_queue = NULL;
+static tthread::mutex& pfs_scan_mutex = *new tthread::mutex();
+static int pfs_scan_width = 1;
+
+// Search a file line by line, like grep: ^ and $ match at the ends of a line.
+// Files that can not be read have no matches, those of 2 GiB or more are
+// marked too large: the regex works with int offsets.
+static void pfs_scan_file(const Regexp* re, ScanJob* job, vector<char>& buf, Regexp::Scratch& scratch) {
+    FILE* f = fopen(job->file.c_str(), "rb");
+    if(!f) return;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    // ftell fails where long can not hold the size. Directories open as
+    // well and may claim any size.
+    if(size < 0 || size > INT_MAX) {
+        fclose(f);
+        job->tooLarge = is_file(job->file);
+        return;
+    }
+    if(size > 0) {
+        buf.resize(size);
+        size = (long)fread(&buf[0], 1, size, f);
+    }
+    fclose(f);
+    if(size <= 0) return;
+
+    const char* data = &buf[0];
+    int len = (int)size;
+    Regexp::Capture caps[Regexp::MAX_GROUPS + 1];
+    for(int pos = 0; pos < len; ) {
+        // Lines before the next possible start can not match.
+        int hit = re->next(data, len, pos);
+        if(hit < 0) break;
+        while(hit > pos && data[hit-1] != '\n') hit--;
+        pos = hit;
+
+        const char* nl = (const char*)memchr(data + pos, '\n', len - pos);
+        int end = nl ? (int)(nl - data) : len;
+        const char* line = data + pos;
+        int lineLen = end - pos;
+        if(lineLen > 0 && line[lineLen-1] == '\r') lineLen--;
+        for(int start = 0; start <= lineLen; ) {
+            int rt = re->match(line, lineLen, start, caps, scratch);
+            if(rt < 0) break;
+            job->matches.push_back(strVec());
+            strVec& m = job->matches.back();
+            for(int i = 0; i <= re->groups(); i++) {
+                m.push_back(caps[i].ptr ? string(caps[i].ptr, caps[i].len) : string());
+            }
+            // An empty match moves on by one.
+            start = caps[0].len > 0 ? rt : rt + 1;
+        }
+        pos = end + 1;
+    }
+}
+
+static void pfs_scan_batch(ScanBatch* batch, vector<char>& buf, Regexp::Scratch& scratch) {
+    for(;;) {
+        size_t i;
+        {
+            tthread::lock_guard<tthread::mutex> guard(batch->mutex);
+            if(batch->next == batch->jobs.size()) return;
+            i = batch->next++;
+        }
+        pfs_scan_file(batch->re, &batch->jobs[i], buf, scratch);
+    }
+}
+
+static void pfs_scan_worker(void* arg) {
+    ScanQueue* queue = (ScanQueue*)arg;
+    vector<char> buf;
+    Regexp::Scratch scratch;
+    ScanBatch* batch;
+    while(queue->take(batch)) {
+        pfs_scan_batch(batch, buf, scratch);
+        tthread::lock_guard<tthread::mutex> guard(batch->mutex);
+        if(--batch->helpers == 0) {
+            batch->cond.notify_all();
+        }
+    }
+}
+
+OS_FUNC(os_pfs_scan) {
+    // pfs.scan(files, regex) -> {file: [[match, group, ...], ...]}
+    if(params < 2 || !(os->isArray(-params+0) || os->isString(-params+0))) {
+        os->setException("pfs.scan expects files and a regular expression.");
+        return 0;
+    }
+    ScanBatch batch;
+    batch.re = slre_toRegexp(os, -params+1);
+    Regexp compiled;
+    if(batch.re == NULL) {
+        if(!os->isString(-params+1)) {
+            os->setException("pfs.scan expects an expression of SLRE.compile or a pattern.");
+            return 0;
+        }
+        OS::String pattern = os->toString(-params+1);
+        if(!compiled.compile(pattern.toChar(), pattern.getLen())) {
+            os->setException((string("SLRE: ") + compiled.error()).c_str());
+            return 0;
+        }
+        batch.re = &compiled;
+    }
+
+    if(os->isString(-params+0)) {
+        batch.jobs.resize(1);
+        batch.jobs[0].file = os->toString(-params+0).toChar();
+    } else {
+        int len = os->getLen(-params+0);
+        batch.jobs.resize(len);
+        for(int i = 0; i < len; i++) {
+            os->pushStackValue(-params+0);
+            os->pushNumber(i);
+            os->getProperty();
+            batch.jobs[i].file = os->popString().toChar();
+        }
+    }
+    batch.next = 0;
+    batch.helpers = min(pfs_scan_width, (int)batch.jobs.size()) - 1;
+
+    int helpers = batch.helpers;
+    if(helpers > 0) {
+        tthread::lock_guard<tthread::mutex> guard(pfs_scan_mutex);
+        if(pfs_scan_queue == NULL) {
+            // Like the pool of isolated tasks, it lives until the process exits.
+            pfs_scan_queue = new ScanQueue(pfs_scan_width - 1, pfs_scan_worker);
+        }
+        for(int i = 0; i < helpers; i++) {
+            pfs_scan_queue->add(&batch);
+        }
+    }
+    vector<char> buf;
+    Regexp::Scratch scratch;
+    pfs_scan_batch(&batch, buf, scratch);
+    if(helpers > 0) {
+        tthread::lock_guard<tthread::mutex> guard(batch.mutex);
+        while(batch.helpers > 0) {
+            batch.cond.wait(batch.mutex);
+        }
+    }
+
+    for(size_t i = 0; i < batch.jobs.size(); i++) {
+        if(batch.jobs[i].tooLarge) {
+            os->setException(("pfs.scan: " + batch.jobs[i].file + " is too large, files of 2 GiB or more can not be scanned.").c_str());
+            return 0;
+        }
+    }
+
+    // Files without matches are left out.
+    os->newObject();
+    for(size_t i = 0; i < batch.jobs.size(); i++) {
+        ScanJob& job = batch.jobs[i];
+        if(job.matches.empty()) continue;
+        os->newArray();
+        for(size_t j = 0; j < job.matches.size(); j++) {
+            strVec& m = job.matches[j];
+            os->newArray();
+            for(size_t k = 0; k < m.size(); k++) {
+                os->pushString(m[k].c_str(), (int)m[k].size());
+                os->addProperty(-2);
+            }
+            os->addProperty(-2);
+        }
+        os->setProperty(-2, job.file.c_str());
+    }
+    return 1;
+}
+
 class IceTeaPFS: public IceTeaPlugin {
 public:
     bool configure(IceTea* os) {
@@ -279,9 +475,16 @@ public:
 
             {OS_TEXT("lookup"),             os_pfs_lookup},
             {OS_TEXT("join"),               os_pfs_join},
+            {OS_TEXT("scan"),               os_pfs_scan},
             {}
         };
 
+        // Worker interpreters have no command line; they keep the main one's width.
+        if(os->getCliHandle()) {
+            int width = atoi(os->getCliHandle()->value("-j").c_str());
+            pfs_scan_width = width > 0 ? width : 1;
+        }
+
         os->pushCFunction(os_pfs_wildcardMatch);
         os->setGlobal("wildcard");
 
@@ -295,7 +498,8 @@ public:
         return "PFS: FileSystem+";
     }
     string getDescription() {
-        return  "FileSystem functionality provided through STLPlus.";
+        return  "FileSystem functionality provided through STLPlus.\n"
+                "- pfs.scan(files, regex) greps files on -j threads";
     }
 };
 ICETEA_INTERNAL_MODULE(IceTeaPFS);
@@ -0,0 +1,220 @@
+/**
+    @file
+    @brief Sampling profiler for build scripts
+
+    With --profile-script <file>, a timer interrupts IceTea at a fixed rate and
+    the VM records the script call stack before it runs its next opcode. This
+    covers the internal libraries as well, they show up as (internal):*.os.
+    Time spent in a native function is counted for the script line calling it.
+
+    On exit, the samples are written to <file> as collapsed stacks: One line per
+    stack, root frame first, frames separated by ';' and followed by the amount
+    of samples. flamegraph.pl and speedscope read this format directly. The
+    functions with the most samples are listed on standard error output.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <stdio.h>
+
+#include "IceTea.h"
+#include "os-icetea.h"
+#include "predef.h"
+#include "InternalIceTeaPlugin.h"
+
+#if defined(PREDEF_PLATFORM_WIN32)
+#   include "tinythread.h"
+#else
+#   include <signal.h>
+#   include <string.h>
+#   include <sys/time.h>
+#endif
+
+using namespace std;
+using namespace ObjectScript;
+
+// Time between two samples, in microseconds.
+#define PROFILER_INTERVAL 1000
+// Deeper stacks are cut off at the root.
+#define PROFILER_MAX_FRAMES 64
+// Amount of functions listed on exit.
+#define PROFILER_TOP 20
+
+class Profiler {
+    OS* os;
+    string dest;
+    int total;
+    map<string, int> stacks;    ///< Collapsed stack => samples
+    map<string, int> self;      ///< Function => samples at the top of the stack
+    map<string, int> inclusive; ///< Function => samples anywhere in the stack
+    #if defined(PREDEF_PLATFORM_WIN32)
+    tthread::thread* timer;
+    volatile bool running;
+    #endif
+
+    static bool bySamples(const pair<string, int>& a, const pair<string, int>& b) {
+        return a.second > b.second;
+    }
+
+    string percent(int samples) {
+        char buf[16];
+        sprintf(buf, "%6.2f%%", total > 0 ? samples * 100.0 / total : 0.0);
+        return buf;
+    }
+
+    #if defined(PREDEF_PLATFORM_WIN32)
+    static void tick(void* arg) {
+        Profiler* self = (Profiler*)arg;
+        while(self->running) {
+            tthread::this_thread::sleep_for(tthread::chrono::microseconds(PROFILER_INTERVAL));
+            self->os->requestSample();
+        }
+    }
+    #else
+    static void tick(int) {
+        profiler.os->requestSample();
+    }
+    #endif
+
+public:
+    static Profiler profiler;
+
+    Profiler() : os(NULL), total(0) {
+        #if defined(PREDEF_PLATFORM_WIN32)
+        timer = NULL;
+        running = false;
+        #endif
+    }
+    ~Profiler() {
+        if(os != NULL) {
+            stop();
+            write();
+        }
+    }
+
+    bool start(OS* vm, const string& file) {
+        os = vm;
+        dest = file;
+        #if defined(PREDEF_PLATFORM_WIN32)
+        running = true;
+        timer = new tthread::thread(tick, this);
+        #else
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = tick;
+        sa.sa_flags = SA_RESTART; // Reads and waits of the task runner go on.
+        sigemptyset(&sa.sa_mask);
+        if(sigaction(SIGPROF, &sa, NULL) != 0) return false;
+
+        struct itimerval tv;
+        tv.it_interval.tv_sec = 0;
+        tv.it_interval.tv_usec = PROFILER_INTERVAL;
+        tv.it_value = tv.it_interval;
+        if(setitimer(ITIMER_PROF, &tv, NULL) != 0) return false;
+        #endif
+        return true;
+    }
+
+    void stop() {
+        #if defined(PREDEF_PLATFORM_WIN32)
+        if(timer != NULL) {
+            running = false;
+            timer->join();
+            delete timer;
+            timer = NULL;
+        }
+        #else
+        struct itimerval tv;
+        memset(&tv, 0, sizeof(tv));
+        setitimer(ITIMER_PROF, &tv, NULL);
+        signal(SIGPROF, SIG_IGN);
+        #endif
+    }
+
+    // Called by the VM before the next opcode.
+    void sample() {
+        OS::CallStackFrame frames[PROFILER_MAX_FRAMES];
+        int count = os->getCallStackFrames(frames, PROFILER_MAX_FRAMES);
+        if(count == 0) return;
+
+        string stack;
+        set<string> seen;
+        for(int i = count-1; i >= 0; i--) {
+            stringstream fn;
+            fn << frames[i].name << " (" << frames[i].file << ")";
+            if(seen.insert(fn.str()).second) inclusive[fn.str()]++;
+            if(i == 0) self[fn.str()]++;
+
+            stringstream frame;
+            frame << frames[i].name << " (" << frames[i].file;
+            if(frames[i].line > 0) frame << ":" << frames[i].line;
+            frame << ")";
+            string str = frame.str();
+            // Both separate fields in the collapsed format.
+            replace(str.begin(), str.end(), ';', ',');
+            replace(str.begin(), str.end(), '\n', ' ');
+            if(!stack.empty()) stack += ";";
+            stack += str;
+        }
+        stacks[stack]++;
+        total++;
+    }
+
+    void write() {
+        ofstream out(dest.c_str());
+        for(map<string, int>::iterator it = stacks.begin(); it != stacks.end(); ++it) {
+            out << it->first << " " << it->second << "\n";
+        }
+        out.close();
+        if(out.fail()) {
+            cerr << "Can not write the script profile to " << dest << endl;
+        }
+
+        vector< pair<string, int> > top(self.begin(), self.end());
+        sort(top.begin(), top.end(), bySamples);
+        if(top.size() > PROFILER_TOP) top.resize(PROFILER_TOP);
+
+        cerr << "Script profile: " << total << " samples, "
+             << PROFILER_INTERVAL << "us apart. Stacks: " << dest << endl;
+        cerr << "   Self   Total  Function" << endl;
+        for(vector< pair<string, int> >::iterator it = top.begin(); it != top.end(); ++it) {
+            cerr << percent(it->second) << " " << percent(inclusive[it->first])
+                 << "  " << it->first << endl;
+        }
+    }
+};
+Profiler Profiler::profiler;
+
+static void profiler_sample(OS*, void* profiler) {
+    ((Profiler*)profiler)->sample();
+}
+
+class IceTeaProfiler: public IceTeaPlugin {
+public:
+    bool configure(IceTea* os) {
+        CLI* cli = os->getCliHandle();
+        if(cli->check("--profile-script")) {
+            os->setSampleCallback(profiler_sample, &Profiler::profiler);
+            if(!Profiler::profiler.start(os, cli->value("--profile-script"))) {
+                cerr << "Can not start the script profiler." << endl;
+                return false;
+            }
+        }
+        return true;
+    }
+    string getName() {
+        return "Profiler";
+    }
+    string getDescription() {
+        return  "Samples the running build scripts.\n"
+                "- Enable with --profile-script <file>\n"
+                "- Writes collapsed stacks for flame graphs and lists the busiest functions";
+    }
+};
+ICETEA_INTERNAL_MODULE(IceTeaProfiler);
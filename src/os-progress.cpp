@@ -0,0 +1,401 @@
+/**
+    @file
+    @brief Native progress line and task output renderer
+
+    The Runner reports every task it launches. Doing that from script meant a
+    flushed write per character of padding, so this module renders the status
+    line natively: One write per update, redraws limited to a few per second,
+    and task output written as one block that never interleaves with the line.
+
+    Task durations are kept in the cache, so later runs can estimate how long
+    the remaining tasks will take.
+*/
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "IceTea.h"
+#include "os-icetea.h"
+#include "predef.h"
+#include "rlutil.h"
+#include "InternalIceTeaPlugin.h"
+
+#if defined(PREDEF_PLATFORM_WIN32)
+#   include <io.h>
+#   define ICETEA_ISATTY(fh) _isatty(_fileno(fh))
+#else
+#   include <unistd.h>
+#   define ICETEA_ISATTY(fh) isatty(fileno(fh))
+#endif
+
+using namespace std;
+using namespace ObjectScript;
+
+// Cache section holding task durations, in seconds.
+#define PROGRESS_TIMINGS "Timings"
+// Minimum time between two redraws of the status line, in seconds.
+#define PROGRESS_REDRAW_INTERVAL 0.1
+
+// ANSI sequences for rlutil's color numbers.
+static const char* progress_ansiColor(int color) {
+    static const char* colors[] = {
+        "\033[22;30m", "\033[22;34m", "\033[22;32m", "\033[22;36m",
+        "\033[22;31m", "\033[22;35m", "\033[22;33m", "\033[22;37m",
+        "\033[01;30m", "\033[01;34m", "\033[01;32m", "\033[01;36m",
+        "\033[01;31m", "\033[01;35m", "\033[01;33m", "\033[01;37m"
+    };
+    if(color < 0 || color > 15) return "";
+    return colors[color];
+}
+
+#if defined(PREDEF_PLATFORM_WIN32)
+// rlutil's number of an ANSI color sequence, -1 for the reset.
+static int progress_colorOf(const string& seq) {
+    for(int c = 0; c < 16; c++) {
+        if(seq == progress_ansiColor(c)) return c;
+    }
+    return -1;
+}
+
+// Length of str on screen, without the color sequences.
+static int progress_visibleLength(const string& str) {
+    int len = 0;
+    for(size_t i = 0; i < str.length(); i++) {
+        if(str[i] == '\033') {
+            size_t end = str.find('m', i);
+            if(end != string::npos) {
+                i = end;
+                continue;
+            }
+        }
+        len++;
+    }
+    return len;
+}
+#endif
+
+class ProgressLine {
+    // One Runner invocation. Sub-builds stack on top of their parent.
+    struct Session {
+        bool compact;
+        int jobs;
+        // Expected duration of each planned task; negative if unknown.
+        map<string, double> expected;
+        double knownLeft;     ///< Sum of known durations still to run.
+        int unknownLeft;      ///< Amount of planned tasks without history.
+        double observedSum;   ///< Durations measured during this run.
+        int observedCount;
+        map<string, double> started;
+    };
+
+    vector<Session> sessions;
+    Filecache* fc;
+    bool tty;
+    bool color;
+    int cols;
+    string line;        ///< The status line as it should look.
+    bool drawn;         ///< Is a status line on screen right now?
+    double lastDraw;
+
+    Session* top() {
+        return sessions.empty() ? NULL : &sessions.back();
+    }
+
+    // Seconds left, or a negative number if there is no data yet.
+    double eta() {
+        Session* s = top();
+        if(s == NULL) return -1;
+        double mean;
+        if(s->observedCount > 0) {
+            mean = s->observedSum / s->observedCount;
+        } else if(s->unknownLeft == 0) {
+            mean = 0;
+        } else {
+            return -1;
+        }
+        double left = s->knownLeft + mean * s->unknownLeft;
+        return left / (s->jobs > 0 ? s->jobs : 1);
+    }
+
+    void write(const string& str) {
+        #if defined(PREDEF_PLATFORM_WIN32)
+        // The console does not read escape sequences: set its colors in between.
+        size_t pos = 0, esc;
+        while((esc = str.find('\033', pos)) != string::npos) {
+            size_t end = str.find('m', esc);
+            if(end == string::npos) break;
+            cout << str.substr(pos, esc - pos) << flush;
+            int c = progress_colorOf(str.substr(esc, end + 1 - esc));
+            if(c < 0) rlutil::resetColor();
+            else      rlutil::setColor(c);
+            pos = end + 1;
+        }
+        cout << str.substr(pos) << flush;
+        #else
+        cout << str << flush;
+        #endif
+    }
+
+    // Make the status line, including the sequences to replace the old one.
+    string render() {
+        string out = "\r" + line;
+        double left = eta();
+        if(left >= 0) {
+            int secs = (int)(left + 0.5);
+            stringstream ss;
+            ss << " (ETA " << secs / 60 << ":" << (secs % 60 < 10 ? "0" : "") << secs % 60 << ")";
+            out += ss.str();
+        }
+        #if defined(PREDEF_PLATFORM_WIN32)
+        // No cursor sequences; pad over what was there before.
+        int visible = progress_visibleLength(out) - 1;
+        if(visible < cols - 1) out.append(cols - 1 - visible, ' ');
+        #else
+        out += "\033[K";
+        #endif
+        return out;
+    }
+
+    string clearSequence() {
+        #if defined(PREDEF_PLATFORM_WIN32)
+        return "\r" + string(cols > 1 ? cols - 1 : 0, ' ') + "\r";
+        #else
+        return "\r\033[K";
+        #endif
+    }
+
+public:
+    ProgressLine() : fc(NULL), tty(false), color(false), cols(80), drawn(false), lastDraw(0) {}
+
+    void init(IceTea* it) {
+        fc = it->getFilecache();
+        tty = ICETEA_ISATTY(stdout) != 0;
+        color = tty && !it->getCliHandle()->check("--no-color");
+        #if defined(PREDEF_PLATFORM_WIN32)
+        // write() resets to these when a painted part ends.
+        if(color) rlutil::saveDefaultColor();
+        #endif
+    }
+
+    bool isTTY() { return tty; }
+
+    string paint(const string& text, int c) {
+        if(!color) return text;
+        return progress_ansiColor(c) + text + "\033[0m";
+    }
+
+    void start(int jobs, bool compact, const vector<string>& keys) {
+        Session s;
+        s.compact = compact && tty;
+        s.jobs = jobs;
+        s.knownLeft = 0;
+        s.unknownLeft = 0;
+        s.observedSum = 0;
+        s.observedCount = 0;
+        for(vector<string>::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+            string val = fc != NULL ? fc->get(*it, PROGRESS_TIMINGS) : "";
+            double d = val.empty() ? -1 : atof(val.c_str());
+            s.expected[*it] = d;
+            if(d >= 0) s.knownLeft += d;
+            else       s.unknownLeft++;
+        }
+        sessions.push_back(s);
+        if(tty) cols = rlutil::tcols();
+    }
+
+    void begin(const string& key) {
+        Session* s = top();
+        if(s != NULL) s->started[key] = OS::getTimeSec();
+    }
+
+    void finish(const string& key, bool ok) {
+        Session* s = top();
+        if(s == NULL) return;
+        map<string, double>::iterator exp = s->expected.find(key);
+        if(exp != s->expected.end()) {
+            if(exp->second >= 0) s->knownLeft -= exp->second;
+            else                 s->unknownLeft--;
+            s->expected.erase(exp);
+        }
+        map<string, double>::iterator st = s->started.find(key);
+        if(st != s->started.end()) {
+            double took = OS::getTimeSec() - st->second;
+            s->started.erase(st);
+            if(ok) {
+                s->observedSum += took;
+                s->observedCount++;
+                if(fc != NULL) {
+                    stringstream ss;
+                    ss << took;
+                    fc->set(key, ss.str(), PROGRESS_TIMINGS);
+                }
+            }
+        }
+    }
+
+    // Report a task. Compact sessions redraw the status line, others print a line.
+    void report(const string& prefix, int idx, int total,
+                const string& title, const string& display, const string& what) {
+        stringstream counter;
+        counter << "[" << idx << "/" << total << "] ";
+        Session* s = top();
+        if(s == NULL || !s->compact) {
+            write(prefix + paint(counter.str(), rlutil::CYAN)
+                + title + "(" + paint(display, rlutil::MAGENTA) + "): " + what + "\n");
+            return;
+        }
+
+        // Keep the line narrower than the terminal, or it wraps and \r stops working.
+        string subject = what;
+        int fixed = prefix.length() + counter.str().length() + title.length()
+                  + display.length() + 4 + 16;
+        int room = cols - fixed;
+        if(room < 8) room = 8;
+        if((int)subject.length() > room) {
+            subject = "..." + subject.substr(subject.length() - room + 3);
+        }
+        line = prefix + paint(counter.str(), rlutil::CYAN)
+             + title + "(" + paint(display, rlutil::MAGENTA) + "): " + subject;
+
+        double now = OS::getTimeSec();
+        if(now - lastDraw >= PROGRESS_REDRAW_INTERVAL || idx == total) {
+            write(render());
+            drawn = true;
+            lastDraw = now;
+        }
+    }
+
+    // Write a block of task output in one go, then put the status line back.
+    void output(string text) {
+        if(text.empty()) return;
+        if(text[text.length()-1] != '\n') text += "\n";
+        string out;
+        if(drawn) out = clearSequence();
+        out += text;
+        Session* s = top();
+        if(s != NULL && s->compact && !line.empty()) {
+            out += render();
+            lastDraw = OS::getTimeSec();
+        } else {
+            drawn = false;
+        }
+        write(out);
+    }
+
+    void done() {
+        Session* s = top();
+        if(s != NULL && s->compact && drawn) {
+            // Show the final state, then leave the line alone.
+            write(render() + "\n");
+        }
+        if(!sessions.empty()) sessions.pop_back();
+        line.clear();
+        drawn = false;
+        if(fc != NULL) fc->sync();
+    }
+};
+
+static ProgressLine progressLine;
+
+OS_FUNC(progress_start) {
+    // progress.start(jobs, compact, keys)
+    int jobs = os->toInt(-params+0);
+    bool compact = os->toBool(-params+1);
+    vector<string> keys;
+    if(params > 2 && os->isArray(-params+2)) {
+        int off = os->getAbsoluteOffs(-params+2);
+        int len = os->getLen(off);
+        for(int i=0; i<len; i++) {
+            os->pushStackValue(off);
+            os->pushNumber(i);
+            os->getProperty();
+            if(os->isString()) keys.push_back(os->toString().toChar());
+            os->pop();
+        }
+    }
+    progressLine.start(jobs, compact, keys);
+    return 0;
+}
+
+OS_FUNC(progress_report) {
+    // progress.report(prefix, index, total, title, display, what)
+    progressLine.report(
+        os->toString(-params+0).toChar(),
+        os->toInt(-params+1),
+        os->toInt(-params+2),
+        os->toString(-params+3).toChar(),
+        os->toString(-params+4).toChar(),
+        os->toString(-params+5).toChar()
+    );
+    return 0;
+}
+
+OS_FUNC(progress_begin) {
+    progressLine.begin(os->toString(-params+0).toChar());
+    return 0;
+}
+
+OS_FUNC(progress_finish) {
+    bool ok = params > 1 ? os->toBool(-params+1) : true;
+    progressLine.finish(os->toString(-params+0).toChar(), ok);
+    return 0;
+}
+
+OS_FUNC(progress_output) {
+    progressLine.output(os->toString(-params+0).toChar());
+    return 0;
+}
+
+OS_FUNC(progress_paint) {
+    string text = os->toString(-params+0).toChar();
+    os->pushString(progressLine.paint(text, os->toInt(-params+1)).c_str());
+    return 1;
+}
+
+OS_FUNC(progress_done) {
+    progressLine.done();
+    return 0;
+}
+
+OS_FUNC(progress_isTTY) {
+    os->pushBool(progressLine.isTTY());
+    return 1;
+}
+
+class IceTeaProgress: public IceTeaPlugin {
+public:
+    bool configure(IceTea* os) {
+        progressLine.init(os);
+
+        OS::FuncDef progressFuncs[] = {
+            {OS_TEXT("start"),          progress_start},
+            {OS_TEXT("report"),         progress_report},
+            {OS_TEXT("begin"),          progress_begin},
+            {OS_TEXT("finish"),         progress_finish},
+            {OS_TEXT("output"),         progress_output},
+            {OS_TEXT("paint"),          progress_paint},
+            {OS_TEXT("done"),           progress_done},
+            {OS_TEXT("__get@isTTY"),    progress_isTTY},
+            {}
+        };
+        os->getModule("progress");
+        os->setFuncs(progressFuncs);
+        os->pop();
+
+        return true;
+    }
+    string getName() {
+        return "Progress";
+    }
+    string getDescription() {
+        return  "Renders the build's status line and task output natively.\n"
+                "- One write per update, with rate-limited redraws\n"
+                "- Task output is written as one uninterrupted block\n"
+                "- Estimates the remaining time from previous runs";
+    }
+};
+ICETEA_INTERNAL_MODULE(IceTeaProgress);
@@ -0,0 +1,141 @@
+/**
+    @file
+    @brief Native merging of settings stores
+
+    Compile and link rules read their settings from several stores: the global
+    ones, the target's native ones and the ones for the language. settings.combine
+    merges one key of all stores, as SettingsContainer.__getCombined does.
+
+    Every file of a target ends up with the same flags. settings.cached(target,
+    kind, fn) calls fn once per target and kind and returns its result from then
+    on, so rules assemble the flag part of a command once instead of per file.
+*/
+
+#include <string>
+#include <map>
+
+#include "IceTea.h"
+#include "os-icetea.h"
+#include "InternalIceTeaPlugin.h"
+
+using namespace std;
+using namespace ObjectScript;
+
+// Append the value at offs to the array at arr_offs, or its items if it is an array.
+static void settings_append(OS* os, int arr_offs, int offs) {
+    if(!os->isArray(offs)) {
+        os->pushStackValue(offs);
+        os->addProperty(arr_offs);
+        return;
+    }
+    int len = os->getLen(offs);
+    for(int i = 0; i < len; i++) {
+        os->pushStackValue(offs);
+        os->pushNumber(i);
+        os->getProperty();
+        os->addProperty(arr_offs);
+    }
+}
+
+OS_FUNC(settings_combine) {
+    // settings.combine(key, store, ...)
+    if(params < 1) return 0;
+    int key = os->getAbsoluteOffs(-params+0);
+
+    // Every non-null value of key, in store order.
+    int found = 0;
+    for(int i = 1; i < params; i++) {
+        int store = key + i;
+        if(os->isNull(store) || !os->in(key, store)) continue;
+        os->pushStackValue(store);
+        os->pushStackValue(key);
+        os->getProperty();
+        if(os->isNull()) {
+            os->pop();
+            continue;
+        }
+        found++;
+    }
+    if(found == 0) return 0;
+
+    // One value, or a first one that can not be merged, is returned as it is.
+    int first = os->getAbsoluteOffs(-found);
+    if(found == 1 || (!os->isArray(first) && !os->isObject(first))) {
+        os->pushStackValue(first);
+        return 1;
+    }
+
+    if(os->isArray(first)) {
+        // [] + out + value
+        os->newArray();
+        int arr = os->getAbsoluteOffs(-1);
+        for(int i = 0; i < found; i++) {
+            settings_append(os, arr, first + i);
+        }
+        return 1;
+    }
+
+    // {} + out + value, through Object.__add
+    os->newObject();
+    for(int i = 0; i < found; i++) {
+        os->pushStackValue(first + i);
+        os->runOp(OP_ADD);
+        if(os->isExceptionSet()) return 0;
+    }
+    return 1;
+}
+
+// Results of settings.cached by target and kind, retained until exit.
+typedef map< pair<int, string>, int > SettingsCache;
+static SettingsCache settings_cache;
+
+OS_FUNC(settings_cached) {
+    // settings.cached(target, kind, fn)
+    if(params < 3 || !os->isFunction(-params+2)) {
+        os->setException("settings.cached expects a target, a kind and a function.");
+        return 0;
+    }
+    int target = os->getAbsoluteOffs(-params+0);
+    pair<int, string> id(os->getValueId(target), os->toString(-params+1).toChar());
+    SettingsCache::iterator it = settings_cache.find(id);
+    if(it != settings_cache.end()) {
+        os->pushValueById(it->second);
+        return 1;
+    }
+
+    os->pushStackValue(target+2);
+    os->pushStackValue(target);
+    os->callFT(0, 1);
+    if(os->isExceptionSet()) return 0;
+    int result = os->getValueId();
+    if(result != 0) {
+        // Primitive values have no id; they are simply built again.
+        os->retainValueById(result);
+        settings_cache[id] = result;
+    }
+    return 1;
+}
+
+class IceTeaSettings: public IceTeaPlugin {
+public:
+    bool configure(IceTea* os) {
+        OS::FuncDef settingsFuncs[] = {
+            {OS_TEXT("combine"), settings_combine},
+            {OS_TEXT("cached"),  settings_cached},
+            {}
+        };
+        os->getModule("settings");
+        os->setFuncs(settingsFuncs);
+        os->pop();
+        return true;
+    }
+    string getName() {
+        return "Settings";
+    }
+    string getDescription() {
+        return  "Merges the settings stores of targets natively.\n"
+                "- settings.combine(key, store, ...) for SettingsContainer\n"
+                "- settings.cached(target, kind, fn) to build flags once per target";
+    }
+};
+ICETEA_INTERNAL_MODULE(IceTeaSettings);
@@ -1,168 +1,219 @@
+/**
+    @file
+    @brief Regular expressions for scripts
+
+    SLRE.compile(pattern, flags) returns a compiled expression to keep around:
+    re.match(buffer, start), re.matchAll(buffer) and re.test(buffer). The
+    engine is in regexp.h; it runs in linear time and speaks SLRE's syntax.
+
+    SLRE.match(pattern, buffer, caps, flags) is kept for existing scripts. It
+    returns the end of the match (or -1) and the captured groups, just like the
+    bundled SLRE did. Its patterns are compiled once per process.
+*/
+
 #include <string>
+#include <map>
 
-#include "slre.h"
+#include "os-slre.h"
+#include "tinythread.h"
 #include "os-icetea.h"
 #include "InternalIceTeaPlugin.h"
 
 using namespace std;
+using namespace ObjectScript;
 
-/**
- * @author: Jan P. B.
- * Purpose: Count parentheses in a string.
- * Used to count capture groups for SLRE - and as string practice for Jan. :)
- *
- * @param {char*} c   : Buffer
- * @param {int}   len : Buffer length
- * @return {int} Number of parenthesis, -1 on error.
- *
- * @NOTE: Might want to comment out the printf()s, or throw some kind of exception...
- */
-#define COUNTBRACKETS_MORE_OP -1
-#define COUNTBRACKETS_MORE_CL -2
-int countbrackets(const char* c, int len) {
-    char prevchar=' ';
-    int braop=0;
-    int bracl=0;
-
-    for(int i=0; i<len; i++) {
-        if (c[i]=='(' && prevchar!='\\') {
-            braop++;
-        } else if (c[i]==')' && prevchar!='\\') {
-            bracl++;
-        }
-        prevchar = c[i];
+// Tags the userdata of compiled expressions.
+static int regexp_crc = (int)(intptr_t)&regexp_crc >> 2;
+
+// Patterns of SLRE.match, shared by all interpreters. A lookup also holds the
+// lock while matching, since the cached expression searches with its own scratch.
+#define SLRE_CACHE_MAX 256
+typedef map< pair<string, int>, Regexp* > SLRECache;
+static SLRECache& slre_cache = *new SLRECache();
+static tthread::mutex& slre_cache_mutex = *new tthread::mutex();
+
+Regexp* slre_toRegexp(OS* os, int offs) {
+    return (Regexp*)os->toUserdata(regexp_crc, offs);
+}
+
+// Compile into re, or set an exception.
+static bool slre_compile(OS* os, Regexp* re, const OS::String& pattern, int flags) {
+    if(!re->compile(pattern.toChar(), pattern.getLen(), flags)) {
+        os->setException((string("SLRE: ") + re->error()).c_str());
+        return false;
     }
+    return true;
+}
 
-    if (braop==bracl) {
-        return braop;
-    } else {
-        if (braop>bracl)
-            //printf("es gibt mehr ( wie )");
-            return COUNTBRACKETS_MORE_OP;
-        else {
-            //printf("es gibt mehr ) wie (");
-            return COUNTBRACKETS_MORE_CL;
+// Add the captures first..last of a match to the array on top. Groups that are
+// not in the pattern or did not take part are empty strings.
+static void slre_add_captures(OS* os, Regexp* re, Regexp::Capture* caps, int first, int last) {
+    for(int i = first; i <= last; i++) {
+        if(i <= re->groups() && caps[i].ptr) {
+            os->pushString(caps[i].ptr, caps[i].len);
+        } else {
+            os->pushString("");
         }
+        os->addProperty(-2);
     }
-    // Silencing "Function reaching end of control"
-    return -3;
 }
 
-
 class IceTeaSLRE: public IceTeaPlugin {
+    static void destruct(OS* os, void* data, void* user_param) {
+        ((Regexp*)data)->~Regexp();
+    }
+
+    static Regexp* toRegexp(OS* os, int offs) {
+        Regexp* re = slre_toRegexp(os, offs);
+        if(re == NULL) {
+            os->setException("SLRE: Expected a compiled expression.");
+        }
+        return re;
+    }
+
     static OS_FUNC(match) {
         // SLRE.match(RegExp, Buffer, Captures, Flags)
         // @returns Array
-        if(!os->isString(-params+0) && os->isString(-params+1)) {
+        if(params < 2 || !os->isString(-params+0) || !os->isString(-params+1)) {
             os->setException("SLRE::match : Expected argument 1 and 2 to be string.");
             return 0;
         }
-        const char* pattern = os->toString(-params+0).toChar();
-        const char* buffer = os->toString(-params+1).toChar();
-        int pat_len = os->getLen(-params+0);
-        int buff_len = os->getLen(-params+1);
-        int pars = countbrackets(pattern, pat_len);
+        OS::String pattern = os->toString(-params+0);
+        OS::String buffer = os->toString(-params+1);
         int flags = 0;
+        if(params > 3 && os->isNumber(-params+3)) {
+            // We export the flags as numbers, so expect only a number.
+            flags = os->toNumber(-params+3);
+        }
 
-        // Optional parameters
-        if(params > 2) {
-            // 3 or more args given.
-            // Second arg is the overriding of capture groups.
-            // Might be useful for whole-string stuff?
-            pars = os->toNumber(-params+2);
-            if(params > 4) {
-                // More than 2 params, the third is flags.
-                // We export the flags as numbers, so expect only a number.
-                if(os->isNumber(-params+3)) {
-                    flags = os->toNumber(-params+3);
+        tthread::lock_guard<tthread::mutex> guard(slre_cache_mutex);
+        pair<string, int> key(string(pattern.toChar(), pattern.getLen()), flags);
+        SLRECache::iterator it = slre_cache.find(key);
+        Regexp* re;
+        if(it != slre_cache.end()) {
+            re = it->second;
+        } else {
+            re = new Regexp();
+            if(!slre_compile(os, re, pattern, flags)) {
+                delete re;
+                return 0;
+            }
+            if(slre_cache.size() >= SLRE_CACHE_MAX) {
+                // Scripts use a handful of patterns; one building them on the fly starts over.
+                for(it = slre_cache.begin(); it != slre_cache.end(); ++it) {
+                    delete it->second;
                 }
+                slre_cache.clear();
             }
+            slre_cache[key] = re;
         }
 
-        // Capture us some results.
-        // Also, this is a workaround for MSVC C2057
-        // See: http://www.fredosaurus.com/notes-cpp/newdelete/50dynamalloc.html
-        typedef struct slre_cap SLRE;
-        SLRE* caps = new SLRE[pars];
-
-        int rt = slre_match(
-            pattern, buffer, buff_len,
-            caps, pars, flags
-        );
-
-        // Prepare result
-        switch(rt) {
-            case SLRE_NO_MATCH:
-                os->pushNumber(rt);
-                os->newArray();
-                delete[] caps;
-                return 2;
-
-            case SLRE_UNEXPECTED_QUANTIFIER:
-                os->setException("SLRE: Unexpected quantifier");
-                delete[] caps;
-                return 0;
-
-            case SLRE_UNBALANCED_BRACKETS:
-                os->setException("SLRE: Unbalanced brackets");
-                delete[] caps;
-                return 0;
-
-            case SLRE_INTERNAL_ERROR:
-                os->setException("SLRE: Internal error");
-                delete[] caps;
-                return 0;
-
-            case SLRE_INVALID_CHARACTER_SET:
-                os->setException("SLRE: Invalid character set");
-                delete[] caps;
-                return 0;
-
-            case SLRE_INVALID_METACHARACTER:
-                os->setException("SLRE: Invalid metacharacter");
-                delete[] caps;
-                return 0;
-
-            case SLRE_CAPS_ARRAY_TOO_SMALL:
-                os->setException("SLRE: (In native code:) Capture array too small");
-                delete[] caps;
-                return 0;
+        // The third argument overrides the number of groups returned.
+        int count = params > 2 && os->isNumber(-params+2) ? (int)os->toNumber(-params+2) : re->groups();
+        if(count < 0) count = 0;
+        Regexp::Capture caps[Regexp::MAX_GROUPS + 1];
+        int rt = re->match(buffer.toChar(), buffer.getLen(), 0, caps);
+        os->pushNumber(rt);
+        os->newArray();
+        if(rt >= 0) slre_add_captures(os, re, caps, 1, count);
+        return 2;
+    }
 
-            case SLRE_TOO_MANY_BRANCHES:
-                os->setException("SLRE: Too many branches");
-                delete[] caps;
-                return 0;
+    static OS_FUNC(compile) {
+        // SLRE.compile(pattern, flags) -> compiled expression
+        if(params < 1 || !os->isString(-params+0)) {
+            os->setException("SLRE::compile : Expected a string.");
+            return 0;
+        }
+        OS::String pattern = os->toString(-params+0);
+        int flags = params > 1 && os->isNumber(-params+1) ? (int)os->toNumber(-params+1) : 0;
 
-            case SLRE_TOO_MANY_BRACKETS:
-                os->setException("SLRE: Too many brackets");
-                delete[] caps;
-                return 0;
+        Regexp* re = new (os->pushUserdata(regexp_crc, sizeof(Regexp), destruct)) Regexp();
+        if(!slre_compile(os, re, pattern, flags)) {
+            return 0;
         }
+        os->pushStackValue(-1);
+        os->getGlobal("SLRE");
+        os->getProperty(-1, "Regexp");
+        os->remove(-2);
+        os->setPrototype(regexp_crc);
+        return 1;
+    }
 
-        // If we got here, then we are totally safe
-        // to return the contents of caps.
+    static OS_FUNC(regexp_match) {
+        // re.match(buffer, start) -> end of the match or -1, captured groups
+        Regexp* re = toRegexp(os, -params-1);
+        if(re == NULL) return 0;
+        OS::String buffer = os->toString(-params+0);
+        int start = params > 1 ? (int)os->toNumber(-params+1) : 0;
+        Regexp::Capture caps[Regexp::MAX_GROUPS + 1];
+        int rt = start < 0 ? -1 : re->match(buffer.toChar(), buffer.getLen(), start, caps);
         os->pushNumber(rt);
         os->newArray();
-        for(int i=0; i<pars; i++) {
-            os->pushString(caps[i].ptr, caps[i].len);
+        if(rt >= 0) slre_add_captures(os, re, caps, 1, re->groups());
+        return 2;
+    }
+
+    static OS_FUNC(regexp_matchAll) {
+        // re.matchAll(buffer) -> [[match, group, ...], ...]
+        Regexp* re = toRegexp(os, -params-1);
+        if(re == NULL) return 0;
+        OS::String buffer = os->toString(-params+0);
+        const char* buf = buffer.toChar();
+        int len = buffer.getLen();
+        Regexp::Capture caps[Regexp::MAX_GROUPS + 1];
+        os->newArray();
+        for(int start = 0; start <= len; ) {
+            int rt = re->match(buf, len, start, caps);
+            if(rt < 0) break;
+            os->newArray();
+            slre_add_captures(os, re, caps, 0, re->groups());
             os->addProperty(-2);
+            // An empty match moves on by one.
+            start = caps[0].len > 0 ? rt : rt + 1;
         }
-        delete[] caps;
-        return 2;
+        return 1;
+    }
+
+    static OS_FUNC(regexp_test) {
+        // re.test(buffer) -> bool
+        Regexp* re = toRegexp(os, -params-1);
+        if(re == NULL) return 0;
+        OS::String buffer = os->toString(-params+0);
+        os->pushBool(re->match(buffer.toChar(), buffer.getLen()) >= 0);
+        return 1;
     }
 
     bool configure(IceTea* it) {
+        OS::FuncDef slreFuncs[] = {
+            {OS_TEXT("match"),   match},
+            {OS_TEXT("compile"), compile},
+            {}
+        };
+        OS::FuncDef regexpFuncs[] = {
+            {OS_TEXT("match"),    regexp_match},
+            {OS_TEXT("matchAll"), regexp_matchAll},
+            {OS_TEXT("test"),     regexp_test},
+            {}
+        };
         it->getModule("SLRE");
-        it->pushCFunction(match);
-        it->setProperty(-2, "match");
+        it->setFuncs(slreFuncs);
+        it->pushNumber(Regexp::IGNORE_CASE);
+        it->setProperty(-2, "IGNORE_CASE");
+        it->newObject();
+        it->setFuncs(regexpFuncs);
+        it->setProperty(-2, "Regexp");
+        it->pop();
         return true;
     }
     string getName() {
         return "SLRE";
     }
     string getDescription() {
-        return  "Basic Regular Expression functionallity, provided via:\n"
-                "- https://github.com/cesanta/slre";
+        return  "Regular expressions in the syntax of SLRE, matched in linear time.\n"
+                "- SLRE.compile(pattern, flags) returns an expression with\n"
+                "  match(buffer, start), matchAll(buffer) and test(buffer)\n"
+                "- SLRE.match(pattern, buffer, caps, flags) caches its patterns";
     }
 };
 ICETEA_INTERNAL_MODULE(IceTeaSLRE);
@@ -0,0 +1,10 @@
+#ifndef OS_SLRE_H
+#define OS_SLRE_H
+
+#include "regexp.h"
+#include "objectscript.h"
+
+/// The expression of SLRE.compile at offs, or NULL for any other value.
+Regexp* slre_toRegexp(ObjectScript::OS* os, int offs);
+
+#endif
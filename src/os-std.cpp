@@ -45,6 +45,13 @@ OS_FUNC(os_die) {
     return 0;
 }
 
+OS_FUNC(string_add) {
+    // "a" + b is "a" .. b, without a script call in between.
+    OS::String self = os->toString(-params-1);
+    os->pushString(self + os->toString(-params+0));
+    return 1;
+}
+
 class IceTeaSTD: public IceTeaPlugin {
 public:
     bool configure(IceTea* os) {
@@ -54,6 +61,11 @@ public:
         os->pushCFunction(os_die);
         os->setGlobal("abort");
 
+        os->getGlobal("String");
+        os->pushCFunction(string_add);
+        os->setProperty(-2, "__add");
+        os->pop();
+
         os->getModule("wildcard");
         os->pushCFunction(wildcard_match);
         os->setProperty(-2, "match");
@@ -66,7 +78,7 @@ public:
     string getDescription() {
         return  "Partially native, partially in OS itself, this extends ObjectScript's primitives.\n"
                 "For example:\n"
-                "- Add += support for arrays and objects\n"
+                "- Add += support for arrays, objects and strings\n"
                 "- Add a public wildcard() function for glob-like matching\n"
                 "- Provide exit() and abort()";
     }
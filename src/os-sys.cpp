@@ -1,4 +1,6 @@
-#include <stdlib.h> // getenv, putenv
+#include <stdlib.h> // getenv, putenv, getloadavg
+#include <stdio.h>
+#include <string.h>
 #include <string>
 
 #include "os-pfs.h" // CALL_STLPLUS_*()
@@ -6,6 +8,10 @@
 #include "predef.h"
 #include "InternalIceTeaPlugin.h"
 
+#if defined(PREDEF_PLATFORM_WIN32)
+#   include <windows.h>
+#endif
+
 using namespace stlplus;
 using namespace ObjectScript;
 using namespace std;
@@ -103,6 +109,63 @@ OS_FUNC(os_sys_putenv) {
     return 1;
 }
 
+// The one-minute load average, or -1 if the platform can not tell us.
+OS_FUNC(os_sys_loadavg) {
+    double load = -1;
+    #if defined(PREDEF_OS_LINUX)
+    FILE* fh = fopen("/proc/loadavg", "r");
+    if(fh != NULL) {
+        if(fscanf(fh, "%lf", &load) != 1) load = -1;
+        fclose(fh);
+    }
+    #elif defined(PREDEF_PLATFORM_UNIX) \
+        || defined(PREDEF_PLATFORM_BSD) \
+        || defined(PREDEF_OS_MACOSX)
+    double avg[1];
+    if(getloadavg(avg, 1) == 1) load = avg[0];
+    #endif
+    os->pushNumber(load);
+    return 1;
+}
+
+// Bytes of memory that can still be handed out without swapping,
+// or -1 if the platform can not tell us.
+OS_FUNC(os_sys_memAvailable) {
+    double avail = -1;
+    #if defined(PREDEF_OS_LINUX)
+    FILE* fh = fopen("/proc/meminfo", "r");
+    if(fh != NULL) {
+        // MemAvailable only exists since Linux 3.14; fall back to free+cached.
+        char line[256];
+        double kb, memFree=-1, cached=-1;
+        while(fgets(line, sizeof(line), fh) != NULL) {
+            if(sscanf(line, "MemAvailable: %lf", &kb) == 1) {
+                avail = kb * 1024;
+                break;
+            }
+            if(sscanf(line, "MemFree: %lf", &kb) == 1) memFree = kb;
+            if(sscanf(line, "Cached: %lf", &kb) == 1) cached = kb;
+        }
+        fclose(fh);
+        if(avail < 0 && memFree >= 0) {
+            avail = (memFree + (cached > 0 ? cached : 0)) * 1024;
+        }
+    }
+    #elif defined(PREDEF_PLATFORM_WIN32)
+    MEMORYSTATUSEX st;
+    st.dwLength = sizeof(st);
+    if(GlobalMemoryStatusEx(&st)) avail = (double)st.ullAvailPhys;
+    #endif
+    os->pushNumber(avail);
+    return 1;
+}
+
+// Seconds on a monotonic clock, for measuring how long something took.
+OS_FUNC(os_sys_time) {
+    os->pushNumber(OS::getTimeSec());
+    return 1;
+}
+
 class IceTeaSystem: public IceTeaPlugin {
 public:
     bool configure(IceTea* os) {
@@ -119,6 +182,11 @@ public:
             // Env
             {OS_TEXT("getenv"),         os_sys_getenv},
             {OS_TEXT("putenv"),         os_sys_putenv},
+            // Host load
+            {OS_TEXT("loadavg"),        os_sys_loadavg},
+            {OS_TEXT("memAvailable"),   os_sys_memAvailable},
+            // Clock
+            {OS_TEXT("__get@time"),     os_sys_time},
             {}
         };
 
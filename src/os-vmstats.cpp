@@ -0,0 +1,270 @@
+/**
+    @file
+    @brief Execution counters of the script VM
+
+    With --vm-stats <file>, IceTea counts every executed opcode by type, the
+    calls and time of every native function and the GC cycles and allocated
+    bytes of each build phase. The numbers are written to <file> as one JSON
+    object on exit.
+
+    Native functions are named after the module, class or global holding
+    them, like pfs.fileModified or SubProcess.tick. Their time includes the
+    script code they call back into.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+#include "IceTea.h"
+#include "os-icetea.h"
+#include "predef.h"
+#include "InternalIceTeaPlugin.h"
+
+using namespace std;
+using namespace ObjectScript;
+
+class VMStats {
+    typedef pair<OS_CFunction, void*> NativeKey;
+    struct Counter {
+        OS_INT64 calls;
+        double seconds;
+        Counter() : calls(0), seconds(0) {}
+    };
+    struct Phase {
+        string name;
+        double seconds;
+        int gcCycles;
+        OS_INT64 allocatedBytes;
+    };
+
+    OS* os;
+    string dest;
+    vector<OS_INT64> opcodes;
+    map<NativeKey, Counter> natives;
+    vector<double> started;     ///< Start of each native call in progress
+    vector<Phase> phases;       ///< The last one is still running
+
+    template<class T>
+    static bool byCount(const pair<string, T>& a, const pair<string, T>& b) {
+        return a.second > b.second;
+    }
+    static bool bySeconds(const pair<string, Counter>& a, const pair<string, Counter>& b) {
+        return a.second.seconds > b.second.seconds;
+    }
+
+    void closePhase() {
+        Phase& p = phases.back();
+        p.seconds = OS::getTimeSec() - p.seconds;
+        p.gcCycles = os->getGCCycles() - p.gcCycles;
+        p.allocatedBytes = os->getTotalAllocatedBytes() - p.allocatedBytes;
+    }
+
+    // Replace the value on top of the stack with its iterator function.
+    // Unlike nextIteratorStep() alone, this finds Object.__iter on Object.
+    bool pushIterator() {
+        os->getProperty(-1, "__iter");
+        if(!os->isFunction()) {
+            os->pop(2);
+            return false;
+        }
+        os->pushStackValue(-2);
+        os->callFT(0, 1);
+        os->remove(-2);
+        if(!os->isFunction()) {
+            os->pop();
+            return false;
+        }
+        return true;
+    }
+
+    // Name every native function reachable from the globals, one level deep.
+    void nameFunctions(map<NativeKey, string>& names) {
+        vector< pair<string, int> > holders;
+        os->pushGlobals();
+        if(pushIterator()) {
+            while(os->nextIteratorStep()) {
+                string key = os->toString(-2).toChar();
+                OS_CFunction func;
+                void* param;
+                if(os->getCFunction(-1, &func, &param)) {
+                    names.insert(make_pair(NativeKey(func, param), key));
+                } else if(os->isObject() || os->isUserdata()) {
+                    holders.push_back(make_pair(key, os->getValueId()));
+                    os->retainValueById(holders.back().second);
+                }
+                os->pop(2);
+            }
+            os->pop();
+        }
+
+        for(vector< pair<string, int> >::iterator it = holders.begin(); it != holders.end(); ++it) {
+            os->pushValueById(it->second);
+            if(pushIterator()) {
+                while(os->nextIteratorStep()) {
+                    OS_CFunction func;
+                    void* param;
+                    if(os->getCFunction(-1, &func, &param)) {
+                        string name = it->first + "." + os->toString(-2).toChar();
+                        names.insert(make_pair(NativeKey(func, param), name));
+                    }
+                    os->pop(2);
+                }
+                os->pop();
+            }
+            os->releaseValueById(it->second);
+        }
+    }
+
+public:
+    static VMStats stats;
+
+    VMStats() : os(NULL) {}
+    ~VMStats() {
+        if(os != NULL) write();
+    }
+
+    void start(OS* vm, const string& file) {
+        os = vm;
+        dest = file;
+        opcodes.assign(OS::getOpcodeCount(), 0);
+        phase("startup");
+        os->setOpcodeCounters(&opcodes[0]);
+    }
+
+    void phase(const string& name) {
+        if(!phases.empty()) closePhase();
+        Phase p;
+        p.name = name;
+        p.seconds = OS::getTimeSec();
+        p.gcCycles = os->getGCCycles();
+        p.allocatedBytes = os->getTotalAllocatedBytes();
+        phases.push_back(p);
+    }
+
+    void enter() {
+        started.push_back(OS::getTimeSec());
+    }
+
+    void leave(OS_CFunction func, void* param) {
+        Counter& c = natives[NativeKey(func, param)];
+        c.calls++;
+        if(!started.empty()) {
+            c.seconds += OS::getTimeSec() - started.back();
+            started.pop_back();
+        }
+    }
+
+    void write() {
+        os->setOpcodeCounters(NULL);
+        os->setNativeCallCallback(NULL);
+        closePhase();
+
+        vector< pair<string, OS_INT64> > ops;
+        for(int i = 0; i < (int)opcodes.size(); i++) {
+            if(opcodes[i] > 0) ops.push_back(make_pair(string(OS::getOpcodeName(i)), opcodes[i]));
+        }
+        sort(ops.begin(), ops.end(), byCount<OS_INT64>);
+
+        // Functions reachable by several names are counted once.
+        map<NativeKey, string> names;
+        nameFunctions(names);
+        map<string, Counter> byName;
+        for(map<NativeKey, Counter>::iterator it = natives.begin(); it != natives.end(); ++it) {
+            map<NativeKey, string>::iterator n = names.find(it->first);
+            string name;
+            if(n != names.end()) {
+                name = n->second;
+            } else {
+                char buf[32];
+                sprintf(buf, "(native %p)", (void*)it->first.first);
+                name = buf;
+            }
+            Counter& c = byName[name];
+            c.calls += it->second.calls;
+            c.seconds += it->second.seconds;
+        }
+        vector< pair<string, Counter> > funcs(byName.begin(), byName.end());
+        sort(funcs.begin(), funcs.end(), bySeconds);
+
+        stringstream ss;
+        ss << "{\n  \"opcodes\": {";
+        for(size_t i = 0; i < ops.size(); i++) {
+            ss << (i ? "," : "") << "\n    " << icetea_json_quote(os, ops[i].first) << ": " << ops[i].second;
+        }
+        ss << "\n  },\n  \"native_functions\": [";
+        for(size_t i = 0; i < funcs.size(); i++) {
+            ss << (i ? "," : "") << "\n    {\"name\": " << icetea_json_quote(os, funcs[i].first)
+               << ", \"calls\": " << funcs[i].second.calls
+               << ", \"seconds\": " << funcs[i].second.seconds << "}";
+        }
+        ss << "\n  ],\n  \"phases\": [";
+        for(size_t i = 0; i < phases.size(); i++) {
+            ss << (i ? "," : "") << "\n    {\"name\": " << icetea_json_quote(os, phases[i].name)
+               << ", \"seconds\": " << phases[i].seconds
+               << ", \"gc_cycles\": " << phases[i].gcCycles
+               << ", \"allocated_bytes\": " << phases[i].allocatedBytes << "}";
+        }
+        ss << "\n  ],\n  \"gc_cycles\": " << os->getGCCycles()
+           << ",\n  \"allocated_bytes\": " << os->getTotalAllocatedBytes() << "\n}\n";
+
+        ofstream out(dest.c_str());
+        out << ss.str();
+        out.close();
+        if(out.fail()) {
+            cerr << "Can not write the VM statistics to " << dest << endl;
+        }
+    }
+};
+VMStats VMStats::stats;
+
+static void vmstats_nativeCall(OS*, OS_CFunction func, void* param, bool enter, void*) {
+    if(enter) VMStats::stats.enter();
+    else      VMStats::stats.leave(func, param);
+}
+
+static bool vmstats_enabled = false;
+
+OS_FUNC(vmstats_phase) {
+    // vmstats.phase(name)
+    if(vmstats_enabled) VMStats::stats.phase(os->toString(-params+0).toChar());
+    return 0;
+}
+
+class IceTeaVMStats: public IceTeaPlugin {
+public:
+    bool configure(IceTea* os) {
+        CLI* cli = os->getCliHandle();
+        if(cli->check("--vm-stats")) {
+            vmstats_enabled = true;
+            VMStats::stats.start(os, cli->value("--vm-stats"));
+            os->setNativeCallCallback(vmstats_nativeCall);
+        }
+
+        OS::FuncDef vmstatsFuncs[] = {
+            {OS_TEXT("phase"),  vmstats_phase},
+            {}
+        };
+        os->getModule("vmstats");
+        os->setFuncs(vmstatsFuncs);
+        os->pop();
+
+        return true;
+    }
+    string getName() {
+        return "VMStats";
+    }
+    string getDescription() {
+        return  "Counts what the script VM spends its time on.\n"
+                "- Executed opcodes by type, calls and time per native function\n"
+                "- GC cycles and allocated bytes per build phase\n"
+                "- Enable with --vm-stats <file>, written as JSON on exit";
+    }
+};
+ICETEA_INTERNAL_MODULE(IceTeaVMStats);
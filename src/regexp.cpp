@@ -0,0 +1,484 @@
+#include <string.h>
+#include <ctype.h>
+#include "regexp.h"
+
+using namespace std;
+
+Regexp::Regexp() : skip(false), anchored(false), opts(0), ngroups(0), cur(NULL), end(NULL) {}
+
+bool Regexp::fail(const char* msg) {
+    err = msg;
+    prog.clear();
+    return false;
+}
+
+int Regexp::emit(Op op, int x, int y) {
+    Inst inst = {op, x, y};
+    prog.push_back(inst);
+    return (int)prog.size() - 1;
+}
+
+// Insert before the fragment starting at at. Jumps within it move along;
+// jumps from earlier code to at now reach the new instruction.
+void Regexp::insert(int at, Op op, int x, int y) {
+    for(size_t i = at; i < prog.size(); i++) {
+        if(prog[i].op == SPLIT || prog[i].op == JMP) {
+            if(prog[i].x >= at) prog[i].x++;
+            if(prog[i].op == SPLIT && prog[i].y >= at) prog[i].y++;
+        }
+    }
+    Inst inst = {op, x, y};
+    prog.insert(prog.begin() + at, inst);
+}
+
+// Folded for (?i), so sets are matched as they are.
+int Regexp::addSet(Set& set) {
+    if(opts & IGNORE_CASE) {
+        for(int c = 'A'; c <= 'Z'; c++) {
+            int lc = c + ('a' - 'A');
+            if((set.bits[c >> 3] & (1 << (c & 7))) || (set.bits[lc >> 3] & (1 << (lc & 7)))) {
+                set.bits[c >> 3] |= 1 << (c & 7);
+                set.bits[lc >> 3] |= 1 << (lc & 7);
+            }
+        }
+    }
+    sets.push_back(set);
+    return (int)sets.size() - 1;
+}
+
+void Regexp::emitByte(int byte) {
+    if((opts & IGNORE_CASE) && isalpha(byte)) {
+        Set set;
+        memset(&set, 0, sizeof(set));
+        set.bits[byte >> 3] |= 1 << (byte & 7);
+        emit(CLASS, addSet(set));
+    } else {
+        emit(CHAR, byte);
+    }
+}
+
+static void set_add(unsigned char* bits, int from, int to) {
+    for(int c = from; c <= to; c++) {
+        bits[c >> 3] |= 1 << (c & 7);
+    }
+}
+
+static int hex_digit(int c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// After a backslash. Sets byte for a single character, or fills set and sets
+// byte to -1 for a class.
+bool Regexp::parseEscape(Set& set, int& byte) {
+    if(cur >= end) return fail("Invalid metacharacter");
+    int c = (unsigned char)*cur++;
+    byte = -1;
+    memset(&set, 0, sizeof(set));
+    switch(c) {
+        case 'n': byte = '\n'; return true;
+        case 'r': byte = '\r'; return true;
+        case 'f': byte = '\f'; return true;
+        case 'v': byte = '\v'; return true;
+        case 't': byte = '\t'; return true;
+        case 'b': byte = '\b'; return true;
+        case 'x': {
+            int hi = end - cur >= 2 ? hex_digit(cur[0]) : -1;
+            int lo = hi >= 0 ? hex_digit(cur[1]) : -1;
+            if(lo < 0) return fail("Invalid metacharacter");
+            cur += 2;
+            byte = hi * 16 + lo;
+            return true;
+        }
+        case 'd': case 'D':
+            set_add(set.bits, '0', '9');
+            break;
+        case 's': case 'S':
+            set_add(set.bits, ' ', ' ');
+            set_add(set.bits, '\t', '\r');
+            break;
+        case 'w': case 'W':
+            set_add(set.bits, '0', '9');
+            set_add(set.bits, 'A', 'Z');
+            set_add(set.bits, 'a', 'z');
+            set_add(set.bits, '_', '_');
+            break;
+        default:
+            if(isalnum(c)) return fail("Invalid metacharacter");
+            byte = c;
+            return true;
+    }
+    if(isupper(c)) {
+        for(int i = 0; i < 32; i++) set.bits[i] = ~set.bits[i];
+    }
+    return true;
+}
+
+// After the opening [. Adds the set, see addSet.
+bool Regexp::parseSet(int& id) {
+    Set set;
+    memset(&set, 0, sizeof(set));
+    bool negate = cur < end && *cur == '^';
+    if(negate) cur++;
+    bool empty = true;
+    while(cur < end && *cur != ']') {
+        int from = (unsigned char)*cur++;
+        if(from == '\\') {
+            Set cls;
+            if(!parseEscape(cls, from)) return false;
+            if(from < 0) {
+                for(int i = 0; i < 32; i++) set.bits[i] |= cls.bits[i];
+                empty = false;
+                continue;
+            }
+        }
+        int to = from;
+        if(end - cur >= 2 && cur[0] == '-' && cur[1] != ']') {
+            cur++;
+            to = (unsigned char)*cur++;
+            if(to == '\\') {
+                Set cls;
+                if(!parseEscape(cls, to)) return false;
+                if(to < 0) return fail("Invalid character set");
+            }
+            if(to < from) return fail("Invalid character set");
+        }
+        set_add(set.bits, from, to);
+        empty = false;
+    }
+    if(cur >= end) return fail("Unbalanced brackets");
+    cur++;
+    if(empty) return fail("Invalid character set");
+    // Folded first, so [^a] with (?i) excludes A as well.
+    id = addSet(set);
+    if(negate) {
+        for(int i = 0; i < 32; i++) sets[id].bits[i] = ~sets[id].bits[i];
+    }
+    return true;
+}
+
+bool Regexp::parseAtom() {
+    int c = (unsigned char)*cur++;
+    switch(c) {
+        case '(': {
+            if(ngroups >= MAX_GROUPS) return fail("Too many brackets");
+            int group = ++ngroups;
+            emit(SAVE, group * 2);
+            if(!parseAlt()) return false;
+            if(cur >= end || *cur != ')') return fail("Unbalanced brackets");
+            cur++;
+            emit(SAVE, group * 2 + 1);
+            return true;
+        }
+        case '[': {
+            int id;
+            if(!parseSet(id)) return false;
+            emit(CLASS, id);
+            return true;
+        }
+        case '.':
+            emit(ANY);
+            return true;
+        case '^':
+            emit(BOL);
+            return true;
+        case '$':
+            emit(EOL);
+            return true;
+        case '*': case '+': case '?':
+            return fail("Unexpected quantifier");
+        case '\\': {
+            Set set;
+            int byte;
+            if(!parseEscape(set, byte)) return false;
+            if(byte >= 0) {
+                emitByte(byte);
+            } else {
+                emit(CLASS, addSet(set));
+            }
+            return true;
+        }
+        default:
+            emitByte(c);
+            return true;
+    }
+}
+
+bool Regexp::parseRepeat() {
+    int start = (int)prog.size();
+    bool assertion = *cur == '^' || *cur == '$';
+    if(!parseAtom()) return false;
+    if(cur >= end || (*cur != '*' && *cur != '+' && *cur != '?')) return true;
+    if(assertion) return fail("Unexpected quantifier");
+
+    char q = *cur++;
+    bool lazy = cur < end && *cur == '?';
+    if(lazy) cur++;
+    if(cur < end && (*cur == '*' || *cur == '+' || *cur == '?')) {
+        return fail("Unexpected quantifier");
+    }
+
+    if(q == '+') {
+        // L: e; SPLIT L, next
+        int next = (int)prog.size() + 1;
+        if(lazy) emit(SPLIT, next, start);
+        else     emit(SPLIT, start, next);
+        return true;
+    }
+    if(q == '*') {
+        // L: SPLIT e, next; e; JMP L
+        insert(start, SPLIT, 0, 0);
+        emit(JMP, start);
+    } else {
+        // SPLIT e, next; e
+        insert(start, SPLIT, 0, 0);
+    }
+    int next = (int)prog.size();
+    prog[start].x = lazy ? next : start + 1;
+    prog[start].y = lazy ? start + 1 : next;
+    return true;
+}
+
+bool Regexp::parseConcat() {
+    while(cur < end && *cur != '|' && *cur != ')') {
+        if(!parseRepeat()) return false;
+    }
+    return true;
+}
+
+bool Regexp::parseAlt() {
+    int start = (int)prog.size();
+    if(!parseConcat()) return false;
+    if(cur >= end || *cur != '|') return true;
+    cur++;
+    // SPLIT a, b; a; JMP next; b
+    insert(start, SPLIT, start + 1, 0);
+    int jmp = emit(JMP);
+    prog[start].y = (int)prog.size();
+    if(!parseAlt()) return false;
+    prog[jmp].x = (int)prog.size();
+    return true;
+}
+
+// Bytes that can start a match from pc. Clears skip if a match can start
+// without consuming one.
+void Regexp::collectFirst(int pc, vector<bool>& seen) {
+    while(skip && !seen[pc]) {
+        seen[pc] = true;
+        const Inst& inst = prog[pc];
+        switch(inst.op) {
+            case CHAR:
+                first.bits[inst.x >> 3] |= 1 << (inst.x & 7);
+                return;
+            case CLASS:
+                for(int i = 0; i < 32; i++) first.bits[i] |= sets[inst.x].bits[i];
+                return;
+            case SPLIT:
+                collectFirst(inst.x, seen);
+                pc = inst.y;
+                break;
+            case JMP:
+                pc = inst.x;
+                break;
+            case SAVE:
+            case BOL:
+                pc++;
+                break;
+            default:
+                skip = false;
+                return;
+        }
+    }
+}
+
+void Regexp::optimize() {
+    prefix.clear();
+    anchored = false;
+    int pc = 0;
+    while(prog[pc].op == SAVE) pc++;
+    if(prog[pc].op == BOL) {
+        anchored = true;
+        return;
+    }
+    for(; prog[pc].op == CHAR || prog[pc].op == SAVE; pc++) {
+        if(prog[pc].op == CHAR) prefix += (char)prog[pc].x;
+    }
+
+    skip = true;
+    memset(&first, 0, sizeof(first));
+    vector<bool> seen(prog.size(), false);
+    collectFirst(0, seen);
+}
+
+bool Regexp::compile(const char* pattern, int len, int flags) {
+    source.assign(pattern, len);
+    err.clear();
+    prog.clear();
+    sets.clear();
+    opts = flags;
+    ngroups = 0;
+    skip = false;
+
+    cur = pattern;
+    end = pattern + len;
+    if(len >= 4 && memcmp(cur, "(?i)", 4) == 0) {
+        opts |= IGNORE_CASE;
+        cur += 4;
+    }
+    emit(SAVE, 0);
+    if(!parseAlt()) return false;
+    if(cur < end) return fail("Unbalanced brackets");
+    emit(SAVE, 1);
+    emit(MATCH);
+    optimize();
+    return true;
+}
+
+// Add pc and everything it reaches without consuming input to a list, in
+// priority order. caps are the thread's slots; SAVE changes them on the way.
+void Regexp::addThread(Scratch& s, int list, int pc, int pos, int len, int* caps) const {
+    for(;;) {
+        int* sparse = &s.sparse[list][0];
+        int* dense = &s.dense[list][0];
+        int n = s.count[list];
+        if(sparse[pc] < n && dense[sparse[pc]] == pc) return;
+        sparse[pc] = n;
+        dense[n] = pc;
+        s.count[list] = n + 1;
+
+        const Inst& inst = prog[pc];
+        switch(inst.op) {
+            case JMP:
+                pc = inst.x;
+                continue;
+            case SPLIT:
+                addThread(s, list, inst.x, pos, len, caps);
+                pc = inst.y;
+                continue;
+            case SAVE:
+                if(inst.x < s.ncap) {
+                    int old = caps[inst.x];
+                    caps[inst.x] = pos;
+                    addThread(s, list, pc + 1, pos, len, caps);
+                    caps[inst.x] = old;
+                    return;
+                }
+                pc++;
+                continue;
+            case BOL:
+                if(pos != 0) return;
+                pc++;
+                continue;
+            case EOL:
+                if(pos != len) return;
+                pc++;
+                continue;
+            default:
+                memcpy(&s.caps[list][pc * s.ncap], caps, s.ncap * sizeof(int));
+                return;
+        }
+    }
+}
+
+int Regexp::match(const char* buf, int len, int start, Capture* caps, Scratch& s) const {
+    if(prog.empty() || start > len) return -1;
+    if(anchored && start > 0) return -1;
+
+    int size = (int)prog.size();
+    s.ncap = caps ? (ngroups + 1) * 2 : 2;
+    for(int i = 0; i < 2; i++) {
+        if((int)s.dense[i].size() < size) {
+            s.dense[i].resize(size);
+            s.sparse[i].resize(size);
+        }
+        if((int)s.caps[i].size() < size * s.ncap) s.caps[i].resize(size * s.ncap);
+        s.count[i] = 0;
+    }
+    s.work.assign(s.ncap, -1);
+    s.best.assign(s.ncap, -1);
+
+    int found = -1;
+    int clist = 0, nlist = 1;
+    for(int pos = start; pos <= len; pos++) {
+        if(found < 0 && (!anchored || pos == 0)) {
+            if(s.count[clist] == 0) {
+                // No thread is alive, so go to where the next match can start.
+                pos = next(buf, len, pos);
+                if(pos < 0) break;
+            }
+            addThread(s, clist, 0, pos, len, &s.work[0]);
+        }
+        if(s.count[clist] == 0) break;
+
+        s.count[nlist] = 0;
+        int c = pos < len ? (unsigned char)buf[pos] : -1;
+        for(int i = 0; i < s.count[clist]; i++) {
+            int pc = s.dense[clist][i];
+            const Inst& inst = prog[pc];
+            int* tcaps = &s.caps[clist][pc * s.ncap];
+            bool step = false;
+            switch(inst.op) {
+                case CHAR:
+                    step = c == inst.x;
+                    break;
+                case ANY:
+                    step = c >= 0;
+                    break;
+                case CLASS:
+                    step = c >= 0 && (sets[inst.x].bits[c >> 3] & (1 << (c & 7)));
+                    break;
+                case MATCH:
+                    // Threads after this one have a lower priority.
+                    found = pos;
+                    memcpy(&s.best[0], tcaps, s.ncap * sizeof(int));
+                    i = s.count[clist];
+                    break;
+                default:
+                    break;
+            }
+            if(step) addThread(s, nlist, pc + 1, pos + 1, len, tcaps);
+        }
+        clist = nlist;
+        nlist = 1 - nlist;
+    }
+
+    if(found < 0) return -1;
+    if(caps) {
+        for(int i = 0; i <= ngroups; i++) {
+            int from = s.best[i * 2], to = s.best[i * 2 + 1];
+            if(from < 0 || to < 0) {
+                caps[i].ptr = NULL;
+                caps[i].len = 0;
+            } else {
+                caps[i].ptr = buf + from;
+                caps[i].len = to - from;
+            }
+        }
+    }
+    return found;
+}
+
+int Regexp::next(const char* buf, int len, int pos) const {
+    if(!prefix.empty()) {
+        const char* p = buf + pos;
+        const char* last = buf + len - prefix.size();
+        while(p <= last) {
+            p = (const char*)memchr(p, prefix[0], last - p + 1);
+            if(p == NULL || memcmp(p, prefix.data(), prefix.size()) == 0) break;
+            p++;
+        }
+        return p == NULL || p > last ? -1 : (int)(p - buf);
+    }
+    if(skip) {
+        const unsigned char* p = (const unsigned char*)buf;
+        while(pos < len && !(first.bits[p[pos] >> 3] & (1 << (p[pos] & 7)))) pos++;
+        return pos < len ? pos : -1;
+    }
+    return pos;
+}
+
+int Regexp::match(const char* buf, int len, int start, Capture* caps) {
+    return match(buf, len, start, caps, own);
+}
@@ -0,0 +1,113 @@
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#include <string>
+#include <vector>
+
+/**
+    @file
+    @brief Compiled regular expressions in SLRE syntax
+
+    A pattern is compiled once into a program for a Pike VM: every thread of
+    the NFA advances in lockstep, so a match takes time linear in the input,
+    whatever the pattern. Threads are kept in priority order, which gives the
+    same leftmost, greedy-first results as SLRE's backtracking.
+
+    Supported: (?i) ^ $ . [...] [^...] ( ) | * + ? and their lazy forms *? +? ??,
+    \s \S \d \D \w \W \n \r \f \v \t \b (a backspace, as in SLRE), \xHH and \ before
+    any other punctuation.
+*/
+
+class Regexp {
+public:
+    enum {
+        IGNORE_CASE = 1,    ///< The value of SLRE_IGNORE_CASE.
+        MAX_GROUPS = 100    ///< As many as SLRE allowed.
+    };
+
+    struct Capture {
+        const char* ptr;
+        int len;
+    };
+
+    /// Thread lists of one search. Keep one per thread to search without allocating.
+    struct Scratch {
+        std::vector<int> dense[2], sparse[2];
+        int count[2];
+        std::vector<int> caps[2];   ///< Capture slots of a thread, by instruction
+        std::vector<int> work;
+        std::vector<int> best;
+        int ncap;
+    };
+
+    Regexp();
+
+    /// False if the pattern is invalid, see error().
+    bool compile(const char* pattern, int len, int flags = 0);
+    const std::string& error() const { return err; }
+    const std::string& pattern() const { return source; }
+    int flags() const { return opts; }
+
+    /// Number of capture groups.
+    int groups() const { return ngroups; }
+
+    /**
+        Find the first match in buf at or after start. Returns the offset where
+        it ends or -1. caps, if given, receives groups()+1 entries: the whole
+        match, then every group. Groups that did not take part are {NULL, 0}.
+    */
+    int match(const char* buf, int len, int start, Capture* caps, Scratch& scratch) const;
+    int match(const char* buf, int len, int start = 0, Capture* caps = NULL);
+
+    /**
+        The first offset at or after pos where a match could start, or -1.
+        Looks for the literal prefix of the pattern, or else for a byte that
+        can begin a match; without either, that is pos itself.
+    */
+    int next(const char* buf, int len, int pos) const;
+
+private:
+    enum Op {
+        CHAR, ANY, CLASS, SPLIT, JMP, SAVE, BOL, EOL, MATCH
+    };
+    struct Inst {
+        Op op;
+        int x, y;   ///< CHAR: x is the byte. CLASS: x is the set. SPLIT: x is preferred.
+    };
+    struct Set {
+        unsigned char bits[32];
+    };
+
+    std::vector<Inst> prog;
+    std::vector<Set> sets;
+    std::string source;
+    std::string err;
+    std::string prefix;     ///< Literal every match starts with.
+    Set first;              ///< Bytes a match can start with, if skip is set.
+    bool skip;
+    bool anchored;
+    int opts;
+    int ngroups;
+    Scratch own;
+
+    // Parser, see regexp.cpp
+    const char* cur;
+    const char* end;
+    bool parseAlt();
+    bool parseConcat();
+    bool parseRepeat();
+    bool parseAtom();
+    bool parseSet(int& id);
+    bool parseEscape(Set& set, int& byte);
+    int emit(Op op, int x = 0, int y = 0);
+    void insert(int at, Op op, int x, int y);
+    void emitByte(int byte);
+    int addSet(Set& set);
+    void optimize();
+    bool fail(const char* msg);
+
+    void addThread(Scratch& s, int list, int pc, int pos, int len, int* caps) const;
+    void collectFirst(int pc, std::vector<bool>& seen);
+};
+
+#endif
@@ -1 +0,0 @@
-#include "../deps/slre/slre.c"
@@ -1,6 +0,0 @@
-#ifndef SLRE_H_WR
-#define SLRE_H_WR
-
-#include "../deps/slre/slre.h"
-
-#endif
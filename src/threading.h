@@ -98,6 +98,7 @@ public:
         }
     }
     inline void stop() {
+        tthread::lock_guard<tthread::mutex> guard(mutex);
         doStop = true;
         cond.notify_all();
     }
@@ -139,6 +140,18 @@ public:
         }
     }
 
+    // Wait for an item at the list's front. False once stop() was called.
+    inline bool take(T& item) {
+        tthread::lock_guard<tthread::mutex> guard(mutex);
+        while(queue.empty() && !doStop) {
+            cond.wait(mutex);
+        }
+        if(doStop) return false;
+        item = queue.front();
+        queue.pop_front();
+        return true;
+    }
+
     inline int size() {
         tthread::lock_guard<tthread::mutex> guard(mutex);
         int size = (int)queue.size();
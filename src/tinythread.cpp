@@ -199,6 +199,7 @@ thread::thread(void (*aFunction)(void *), void * aArg)
 
   // The thread is now alive
   mNotAThread = false;
+  mReleased = false;
 
   // Create the thread
 #if defined(_TTHREAD_WIN32_)
@@ -212,6 +213,7 @@ thread::thread(void (*aFunction)(void *), void * aArg)
   if(!mHandle)
   {
     mNotAThread = true;
+    mReleased = true;
     delete ti;
   }
 }
@@ -224,7 +226,13 @@ thread::~thread()
 
 void thread::join()
 {
-  if(joinable())
+  // A thread that has finished already is not joinable, but its handle still
+  // has to be joined to free it
+  mDataMutex.lock();
+  bool released = mReleased;
+  mReleased = true;
+  mDataMutex.unlock();
+  if(!released)
   {
 #if defined(_TTHREAD_WIN32_)
     WaitForSingleObject(mHandle, INFINITE);
@@ -246,15 +254,16 @@ bool thread::joinable() const
 void thread::detach()
 {
   mDataMutex.lock();
-  if(!mNotAThread)
+  if(!mReleased)
   {
 #if defined(_TTHREAD_WIN32_)
     CloseHandle(mHandle);
 #elif defined(_TTHREAD_POSIX_)
     pthread_detach(mHandle);
 #endif
-    mNotAThread = true;
+    mReleased = true;
   }
+  mNotAThread = true;
   mDataMutex.unlock();
 }
 
@@ -0,0 +1,148 @@
+/*
+    Stress test: OSThreadHeapManager shared by several threads.
+
+    Eight threads allocate and free raw blocks, half of which are freed by
+    another thread through a shared table of slots. Then, after one
+    interpreter made on the main thread, six interpreters run on their own
+    threads with the same manager, and one of them is released on the main
+    thread. Finally a bulk manager frees nothing until
+    it is released. Exits with 1 if a result or the counters are off.
+    Build and run it with:
+        g++ -Isrc -Wno-switch -pthread tests/bench/thread-heap.cpp src/objectscript.cpp src/os-heap.cpp src/tinythread.cpp -o out/thread-heap && out/thread-heap
+    Add -fsanitize=thread to have the remote free lists checked for races.
+    With -O1 or more objectscript.cpp also needs -fno-strict-aliasing and
+    -fno-lifetime-dse, or the first interpreter crashes while it starts.
+
+    It is not a script, so run_tests.os does not pick it up.
+*/
+
+#include "objectscript.h"
+#include "os-heap.h"
+#include "tinythread.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+using namespace ObjectScript;
+
+#define THREAD_HEAP_RAW_THREADS 8
+#define THREAD_HEAP_VM_THREADS 6
+#define THREAD_HEAP_ROUNDS 200000
+#define THREAD_HEAP_SLOTS 4096
+
+static OSThreadHeapManager * manager;
+static void * volatile slots[THREAD_HEAP_SLOTS];
+static OS * handoff;
+static volatile int failures;
+
+static unsigned nextRandom(unsigned& seed)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+static void fail(const char * what)
+{
+	printf("FAILED: %s\n", what);
+	OS_ATOMIC_ADD(&failures, 1);
+}
+
+// Every other block goes to a random slot, the block found there is freed
+// here although another thread allocated it.
+static void rawThread(void * arg)
+{
+	unsigned seed = (unsigned)(size_t)arg;
+	std::vector<char*> own;
+	for(int i = 0; i < THREAD_HEAP_ROUNDS; i++){
+		int size = 1 + nextRandom(seed) % (i % 50 == 0 ? 70000 : 200);
+		char * p = (char*)manager->malloc(size OS_DBG_FILEPOS);
+		if(!p){
+			fail("malloc");
+			return;
+		}
+		memset(p, 0x5a, size);
+		if(i & 1){
+			own.push_back(p);
+		}else{
+			void * old = __atomic_exchange_n(&slots[nextRandom(seed) % THREAD_HEAP_SLOTS], (void*)p, __ATOMIC_ACQ_REL);
+			manager->free(old);
+		}
+		if(own.size() > 100){
+			for(size_t j = 0; j < own.size(); j++){
+				manager->free(own[j]);
+			}
+			own.clear();
+		}
+	}
+	for(size_t j = 0; j < own.size(); j++){
+		manager->free(own[j]);
+	}
+}
+
+static void vmThread(void * keep)
+{
+	OS * os = OS::create((OS::MemoryManager*)manager);
+	os->eval("var a = []; for(var i = 0; i < 20000; i++){ a.push({x: i, s: 's'..i}); } var t = 0; for(var _, v in a) t = t + v.x; return t", 0, 1);
+	if(os->popNumber() != 199990000.0){
+		fail("script result");
+	}
+	if(keep){
+		handoff = os;
+		return;
+	}
+	os->release();
+}
+
+int main()
+{
+	manager = new OSThreadHeapManager();
+	std::vector<tthread::thread*> threads;
+	for(int i = 0; i < THREAD_HEAP_RAW_THREADS; i++){
+		threads.push_back(new tthread::thread(rawThread, (void*)(size_t)(i + 1)));
+	}
+	for(size_t i = 0; i < threads.size(); i++){
+		threads[i]->join();
+		delete threads[i];
+	}
+	threads.clear();
+	for(int i = 0; i < THREAD_HEAP_SLOTS; i++){
+		manager->free(slots[i]);
+	}
+
+	// The first interpreter registers the native bindings in a global list
+	// that is not locked. IceTea creates its main interpreter first as well.
+	OS * primer = OS::create((OS::MemoryManager*)manager);
+	for(int i = 0; i < THREAD_HEAP_VM_THREADS; i++){
+		threads.push_back(new tthread::thread(vmThread, i == 0 ? (void*)1 : NULL));
+	}
+	for(size_t i = 0; i < threads.size(); i++){
+		threads[i]->join();
+		delete threads[i];
+	}
+	if(handoff){
+		handoff->release(); // its arena belongs to a finished thread
+	}
+	primer->release();
+
+	OSThreadHeapManager::ContentionStats contention;
+	manager->getContentionStats(contention);
+	printf("arenas %u, lookups %u, remote frees %u, retries %u, drains %u\n",
+		contention.arena_count, contention.lookup_count, contention.remote_free_count,
+		contention.retry_count, contention.drain_count);
+	if(contention.arena_count < 2 || contention.remote_free_count == 0){
+		fail("no block was freed by another thread");
+	}
+	manager->release();
+
+	OSThreadHeapManager * bulk = new OSThreadHeapManager(true);
+	OS * os = OS::create((OS::MemoryManager*)bulk);
+	bulk->release();
+	os->eval("var a = []; for(var i = 0; i < 20000; i++) a.push('s'..i); return #a", 0, 1);
+	if(os->popNumber() != 20000){
+		fail("bulk script result");
+	}
+	os->release();
+
+	printf(failures ? "FAILED\n" : "OK\n");
+	return failures ? 1 : 0;
+}